@@ -2,6 +2,7 @@
 #define OCTOON_CAUSTIC_CAMERA_H_
 
 #include <octoon/caustic/render_object.h>
+#include <octoon/caustic/film.h>
 
 namespace octoon
 {
@@ -13,9 +14,30 @@ namespace octoon
 			Camera() noexcept;
 			virtual ~Camera() noexcept;
 
+			// Exposure as a part of the [0, 1] interval between each object's transform and its motion transform.
+			void setShutter(float open, float close) noexcept;
+			float getShutterOpen() const noexcept;
+			float getShutterClose() const noexcept;
+
+			// Where the pipeline accumulates this camera's image, every camera starts with its own.
+			void setFilm(const std::shared_ptr<Film>& film) noexcept;
+			const std::shared_ptr<Film>& getFilm() const noexcept;
+
+			// Primary rays of a size.x * size.y tile at offset within an image of the given resolution. Ray i
+			// covers pixel (offset.x + i % size.x, offset.y + i / size.x) jittered by random[i], at times[i],
+			// lens[i] is a second pair of uniform samples for cameras with an aperture.
+			// The camera looks down its local -z with +y up, pixel rows go from the bottom up.
+			virtual void generateRays(const RadeonRays::int2& resolution, const RadeonRays::int2& offset, const RadeonRays::int2& size, const RadeonRays::float2* random, const RadeonRays::float2* lens, const float* times, RadeonRays::ray* rays) const noexcept = 0;
+
 		private:
 			Camera(const Camera&) noexcept = delete;
 			Camera& operator=(const Camera&) noexcept = delete;
+
+		private:
+			float shutterOpen_;
+			float shutterClose_;
+
+			std::shared_ptr<Film> film_;
 		};
 	}
 }
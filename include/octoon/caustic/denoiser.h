@@ -0,0 +1,62 @@
+#ifndef OCTOON_CAUSTIC_DENOISER_H_
+#define OCTOON_CAUSTIC_DENOISER_H_
+
+#include <vector>
+#include <cstdint>
+#include <radeon_rays.h>
+
+#include <octoon/caustic/film.h>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) guided by the albedo and normal AOVs
+		// of a film. The lighting is divided by the albedo before filtering, so textures stay sharp, and
+		// the luminance edge stop scales with the standard deviation of every pixel, so converged
+		// regions are left alone while noisy ones are blurred.
+		class Denoiser final
+		{
+		public:
+			Denoiser() noexcept;
+			~Denoiser() noexcept;
+
+			// Each iteration doubles the footprint of the 5x5 kernel, 5 covers 62 pixels.
+			void setIterations(std::uint32_t iterations) noexcept;
+			std::uint32_t getIterations() const noexcept;
+
+			// Luminance differences are compared against sigma times the standard deviation.
+			void setColorSigma(float sigma) noexcept;
+			float getColorSigma() const noexcept;
+
+			// Exponent of the cosine between two normals.
+			void setNormalSigma(float sigma) noexcept;
+			float getNormalSigma() const noexcept;
+
+			void setAlbedoSigma(float sigma) noexcept;
+			float getAlbedoSigma() const noexcept;
+
+			// Mean radiance of the film filtered into output, rows from the bottom up like the film.
+			// Without the albedo and normal AOVs only the luminance edge stop is used.
+			void denoise(const Film& film, std::vector<RadeonRays::float3>& output) noexcept;
+
+		private:
+			Denoiser(const Denoiser&) noexcept = delete;
+			Denoiser& operator=(const Denoiser&) noexcept = delete;
+
+		private:
+			std::uint32_t iterations_;
+
+			float colorSigma_;
+			float normalSigma_;
+			float albedoSigma_;
+
+			std::vector<RadeonRays::float3> color_[2];
+			std::vector<float> variance_[2];
+			std::vector<RadeonRays::float3> albedo_;
+			std::vector<RadeonRays::float3> normal_;
+		};
+	}
+}
+
+#endif
@@ -13,6 +13,9 @@ namespace octoon
 			EnvironmentCamera() noexcept;
 			virtual ~EnvironmentCamera() noexcept;
 
+			// Equirectangular panorama, the image center looks down -z and the rows span the poles.
+			void generateRays(const RadeonRays::int2& resolution, const RadeonRays::int2& offset, const RadeonRays::int2& size, const RadeonRays::float2* random, const RadeonRays::float2* lens, const float* times, RadeonRays::ray* rays) const noexcept override;
+
 		private:
 			EnvironmentCamera(const EnvironmentCamera&) noexcept = delete;
 			EnvironmentCamera& operator=(const EnvironmentCamera&) noexcept = delete;
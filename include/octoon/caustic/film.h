@@ -0,0 +1,200 @@
+#ifndef OCTOON_CAUSTIC_FILM_H_
+#define OCTOON_CAUSTIC_FILM_H_
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <iosfwd>
+#include <cstdint>
+#include <radeon_rays.h>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		// Per pixel data written next to the beauty, taken from the first hit of every sample. Except for
+		// the ids, which hold those of the latest sample, films store sums like the radiance.
+		enum class FilmAov : std::uint32_t
+		{
+			Depth, // distance to the first hit, zero where nothing was hit
+			Normal, // world space shading normal
+			Albedo,
+			ShapeId,
+			MaterialId,
+			Direct, // emission of the first hit and the lights sampled from it
+			Indirect, // everything else
+			SampleCount,
+
+			Count
+		};
+
+		// Skips value-initialization when a vector grows, the pages of a fresh buffer are then backed by
+		// the NUMA node of whichever thread writes them first.
+		template<typename T>
+		class UninitializedAllocator : public std::allocator<T>
+		{
+		public:
+			template<typename U>
+			struct rebind
+			{
+				typedef UninitializedAllocator<U> other;
+			};
+
+			UninitializedAllocator() noexcept = default;
+
+			template<typename U>
+			UninitializedAllocator(const UninitializedAllocator<U>&) noexcept
+			{
+			}
+
+			template<typename U>
+			void construct(U*) noexcept
+			{
+			}
+
+			template<typename U, typename... Args>
+			void construct(U* p, Args&&... args)
+			{
+				::new((void*)p) U(std::forward<Args>(args)...);
+			}
+		};
+
+		// Accumulation of one tile with its own contiguous rows, so a worker fills it without
+		// touching the cache lines of the full resolution film.
+		class FilmTile final
+		{
+		public:
+			FilmTile() noexcept;
+			~FilmTile() noexcept;
+
+			// Resizes to the tile and clears the radiance and the AOVs enabled in the mask (1 << FilmAov).
+			void reset(const RadeonRays::int2& offset, const RadeonRays::int2& size, std::uint32_t aovs = 0) noexcept;
+
+			const RadeonRays::int2& getOffset() const noexcept;
+			const RadeonRays::int2& getSize() const noexcept;
+
+			// Pixel x, y of the tile at y * size.x + x.
+			RadeonRays::float3* getRadiance() noexcept;
+			const RadeonRays::float3* getRadiance() const noexcept;
+
+			// Number of estimates and sum of their squared luminance per pixel.
+			std::uint32_t* getSampleCount() noexcept;
+			const std::uint32_t* getSampleCount() const noexcept;
+
+			float* getMoment() noexcept;
+			const float* getMoment() const noexcept;
+
+			std::uint32_t* getColor() noexcept;
+			const std::uint32_t* getColor() const noexcept;
+
+			// nullptr unless enabled at reset()
+			RadeonRays::float3* getAov(FilmAov aov) noexcept;
+			const RadeonRays::float3* getAov(FilmAov aov) const noexcept;
+			std::uint32_t getAovMask() const noexcept;
+
+			// Region, radiance, moments and AOVs, e.g. to ship the tile to another process. load() rejects
+			// tiles of more than maxPixels before allocating anything.
+			bool save(std::ostream& stream) const noexcept;
+			bool load(std::istream& stream, std::size_t maxPixels = 8192 * 8192) noexcept;
+
+			// Bytes save() writes for a tile of size with the AOVs of the mask.
+			static std::size_t getStreamSize(const RadeonRays::int2& size, std::uint32_t aovs) noexcept;
+
+		private:
+			RadeonRays::int2 offset_;
+			RadeonRays::int2 size_;
+
+			std::vector<RadeonRays::float3> aovs_[(std::size_t)FilmAov::Count];
+
+			std::vector<RadeonRays::float3> radiance_;
+			std::vector<std::uint32_t> sampleCount_;
+			std::vector<float> moment_;
+			std::vector<std::uint32_t> color_;
+		};
+
+		// Radiance a camera accumulated over the frames and its tonemapped image.
+		class Film final
+		{
+		public:
+			Film() noexcept;
+			Film(std::uint32_t w, std::uint32_t h) noexcept;
+			~Film() noexcept;
+
+			// Without clearing, the buffers are left untouched and every region must be cleared before it is
+			// used, ideally by the thread that renders it so its NUMA node backs the pages.
+			void resize(std::uint32_t w, std::uint32_t h, bool clear = true) noexcept;
+			void clear() noexcept;
+			void clear(const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept;
+
+			std::uint32_t getWidth() const noexcept;
+			std::uint32_t getHeight() const noexcept;
+
+			// Sum of the estimates per pixel, rows from the bottom up.
+			RadeonRays::float3* getRadiance() noexcept;
+			const RadeonRays::float3* getRadiance() const noexcept;
+
+			// Estimates per pixel and the sum of their squared luminance, together with the
+			// radiance they give the mean and variance of each pixel.
+			const std::uint32_t* getSampleCount() const noexcept;
+			const float* getMoment() const noexcept;
+
+			float getVariance(std::uint32_t x, std::uint32_t y) const noexcept;
+
+			// AOVs cost memory and a little time in the pipeline, so each one is enabled separately.
+			void setAovEnable(FilmAov aov, bool enable) noexcept;
+			bool getAovEnable(FilmAov aov) const noexcept;
+			std::uint32_t getAovMask() const noexcept;
+
+			// nullptr unless enabled
+			const RadeonRays::float3* getAov(FilmAov aov) const noexcept;
+
+			// RGBA8 per pixel.
+			std::uint32_t* getColor() noexcept;
+			const std::uint32_t* data() const noexcept;
+
+			// Adds a finished tile to the film and hands the new sums back in the tile, so it can be
+			// tonemapped locally. Both may be called by several workers at once, and both ignore tiles
+			// that don't lie inside the film.
+			void accumulate(FilmTile& tile) noexcept;
+			// Copies the colors of the tile into the image.
+			void resolve(const FilmTile& tile) noexcept;
+			// Moves what a region accumulated into the tile and clears it in the film, so a render node
+			// hands out only the samples added since the last take.
+			void take(const RadeonRays::int2& offset, const RadeonRays::int2& size, FilmTile& tile) noexcept;
+
+			// Holds off accumulate() while another thread reads the buffers, e.g. std::lock_guard<const Film>.
+			void lock() const noexcept;
+			void unlock() const noexcept;
+
+			// Accumulation state for checkpoints, load() fails on a stream of another resolution.
+			bool save(std::ostream& stream) const noexcept;
+			bool load(std::istream& stream) noexcept;
+
+		private:
+			bool contains(const RadeonRays::int2& offset, const RadeonRays::int2& size) const noexcept;
+
+		private:
+			Film(const Film&) noexcept = delete;
+			Film& operator=(const Film&) noexcept = delete;
+
+		private:
+			std::uint32_t width_;
+			std::uint32_t height_;
+
+			template<typename T>
+			using Buffer = std::vector<T, UninitializedAllocator<T>>;
+
+			Buffer<RadeonRays::float3> hdr_;
+			Buffer<std::uint32_t> sampleCount_;
+			Buffer<float> moment_;
+			Buffer<std::uint32_t> ldr_;
+
+			std::uint32_t aovMask_;
+			Buffer<RadeonRays::float3> aovs_[(std::size_t)FilmAov::Count];
+
+			mutable std::mutex mutex_;
+		};
+	}
+}
+
+#endif
@@ -13,9 +13,33 @@ namespace octoon
 			FilmCamera() noexcept;
 			virtual ~FilmCamera() noexcept;
 
+			// Vertical field of view in degrees.
+			void setFov(float fov) noexcept;
+			float getFov() const noexcept;
+
+			// Thin lens depth of field, a zero aperture (lens radius in world units) is a pinhole.
+			void setAperture(float aperture) noexcept;
+			float getAperture() const noexcept;
+
+			// Distance along the view axis that stays in focus.
+			void setFocusDistance(float distance) noexcept;
+			float getFocusDistance() const noexcept;
+
+			// Number of diaphragm blades shaping the bokeh, fewer than three is a round aperture.
+			void setBladeCount(std::uint32_t count) noexcept;
+			std::uint32_t getBladeCount() const noexcept;
+
+			void generateRays(const RadeonRays::int2& resolution, const RadeonRays::int2& offset, const RadeonRays::int2& size, const RadeonRays::float2* random, const RadeonRays::float2* lens, const float* times, RadeonRays::ray* rays) const noexcept override;
+
 		private:
 			FilmCamera(const FilmCamera&) noexcept = delete;
 			FilmCamera& operator=(const FilmCamera&) noexcept = delete;
+
+		private:
+			float fov_;
+			float aperture_;
+			float focusDistance_;
+			std::uint32_t bladeCount_;
 		};
 	}
 }
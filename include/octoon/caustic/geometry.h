@@ -1,8 +1,11 @@
 #ifndef OCTOON_CAUSTIC_GEOMETRY_H_
 #define OCTOON_CAUSTIC_GEOMETRY_H_
 
+#include <vector>
+#include <mutex>
 #include <octoon/caustic/render_object.h>
 #include <octoon/caustic/material.h>
+#include <octoon/caustic/mesh.h>
 
 namespace RadeonRays
 {
@@ -13,6 +16,8 @@ namespace octoon
 {
 	namespace caustic
 	{
+		class GeometryInstance;
+
 		class Geometry final : public RenderObject
 		{
 		public:
@@ -24,13 +29,41 @@ namespace octoon
 
 			void setShape(const float* vertices, int vnum, int vstride, const int* indices, int istride, const int* numfacevertices, int numfaces) noexcept;
 
+			void setMesh(const std::shared_ptr<Mesh>& mesh) noexcept;
+			const std::shared_ptr<Mesh>& getMesh() const noexcept;
+
+			// Call after moving the vertices of the current mesh in place, the topology must stay the same.
+			// The native backend refits its acceleration structure instead of rebuilding it.
+			void updateMesh() noexcept;
+
+			std::int32_t getShapeId() const noexcept;
+
+		private:
+			friend class GeometryInstance;
+			RadeonRays::Shape* getShape() const noexcept;
+
+			void addInstance(GeometryInstance* instance) noexcept;
+			void removeInstance(GeometryInstance* instance) noexcept;
+
+		private:
+			void onActivate() noexcept override;
+			void onDeactivate() noexcept override;
+
+			void onMoveAfter() noexcept override;
+
 		private:
 			Geometry(const Geometry&) noexcept = delete;
 			Geometry& operator=(const Geometry&) noexcept = delete;
 
 		private:
 			std::shared_ptr<Material> material_;
+			std::shared_ptr<Mesh> data_;
 			RadeonRays::Shape* mesh_;
+			std::int32_t shapeId_;
+
+			// instances may be created on other loader threads than the one updating the mesh
+			std::mutex instancesLock_;
+			std::vector<GeometryInstance*> instances_;
 		};
 	}
 }
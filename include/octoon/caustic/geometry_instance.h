@@ -0,0 +1,54 @@
+#ifndef OCTOON_CAUSTIC_GEOMETRY_INSTANCE_H_
+#define OCTOON_CAUSTIC_GEOMETRY_INSTANCE_H_
+
+#include <octoon/caustic/geometry.h>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		// Places a shared Geometry with its own transform and an optional material override,
+		// the vertex data and acceleration structure stay with the geometry.
+		class GeometryInstance final : public RenderObject
+		{
+		public:
+			GeometryInstance() noexcept;
+			GeometryInstance(const std::shared_ptr<Geometry>& geometry) noexcept;
+			virtual ~GeometryInstance() noexcept;
+
+			void setGeometry(const std::shared_ptr<Geometry>& geometry) noexcept;
+			const std::shared_ptr<Geometry>& getGeometry() const noexcept;
+
+			void setMaterial(const std::shared_ptr<Material>& material) noexcept;
+			const std::shared_ptr<Material>& getMaterial() const noexcept;
+
+			std::int32_t getShapeId() const noexcept;
+
+		private:
+			friend class Geometry;
+			void onShapeChange() noexcept;
+
+			void createShape() noexcept;
+			void destroyShape() noexcept;
+
+		private:
+			void onActivate() noexcept override;
+			void onDeactivate() noexcept override;
+
+			void onMoveAfter() noexcept override;
+
+		private:
+			GeometryInstance(const GeometryInstance&) noexcept = delete;
+			GeometryInstance& operator=(const GeometryInstance&) noexcept = delete;
+
+		private:
+			std::shared_ptr<Geometry> geometry_;
+			std::shared_ptr<Material> material_;
+
+			RadeonRays::Shape* instance_;
+			std::int32_t shapeId_;
+		};
+	}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef OCTOON_CAUSTIC_IMAGE_WRITER_H_
+#define OCTOON_CAUSTIC_IMAGE_WRITER_H_
+
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+#include <octoon/caustic/film.h>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		enum class ExrPixelType
+		{
+			Half,
+			Float
+		};
+
+		enum class ExrCompression
+		{
+			None,
+			RLE
+		};
+
+		// One float per pixel taken from data[(y * width + x) * stride], with y counted from the bottom row.
+		// With a sample count the value is the mean, data then holds the sums of the film.
+		struct ImageChannel
+		{
+			std::string name;
+
+			const float* data;
+			std::uint32_t stride;
+			const std::uint32_t* sampleCount;
+		};
+
+		// Linear HDR output. The writers convert and compress one scanline at a time straight from the
+		// source buffers, so memory stays at a single line whatever the resolution. Films add a layer
+		// of channels for every enabled AOV, ids and the sample count are written as they are.
+		bool WriteEXR(std::ostream& stream, std::uint32_t width, std::uint32_t height, const std::vector<ImageChannel>& channels, ExrPixelType type = ExrPixelType::Half, ExrCompression compression = ExrCompression::RLE) noexcept;
+		bool WriteEXR(std::ostream& stream, const Film& film, ExrPixelType type = ExrPixelType::Half, ExrCompression compression = ExrCompression::RLE) noexcept;
+		bool WritePFM(std::ostream& stream, const Film& film) noexcept;
+
+		void WriteEXR(const std::string& filepath, const Film& film, ExrPixelType type = ExrPixelType::Half, ExrCompression compression = ExrCompression::RLE) noexcept(false);
+		void WritePFM(const std::string& filepath, const Film& film) noexcept(false);
+	}
+}
+
+#endif
@@ -173,6 +173,50 @@ namespace octoon
 			return H;
 		}
 
+		// Shirley's concentric mapping, keeps the stratification of Xi.
+		inline RadeonRays::float2 ConcentricSampleDisk(const RadeonRays::float2& Xi)
+		{
+			float x = Xi.x * 2.0f - 1.0f;
+			float y = Xi.y * 2.0f - 1.0f;
+
+			if (x == 0.0f && y == 0.0f)
+				return RadeonRays::float2(0.0f, 0.0f);
+
+			float r, theta;
+			if (std::abs(x) > std::abs(y))
+			{
+				r = x;
+				theta = (PI / 4) * (y / x);
+			}
+			else
+			{
+				r = y;
+				theta = (PI / 2) - (PI / 4) * (x / y);
+			}
+
+			return RadeonRays::float2(r * std::cos(theta), r * std::sin(theta));
+		}
+
+		// Uniform point in a regular polygon with the given number of corners on the unit circle.
+		inline RadeonRays::float2 UniformSamplePolygon(const RadeonRays::float2& Xi, std::uint32_t corners)
+		{
+			float u = Xi.x * corners;
+			float edge = std::floor(u);
+			u -= edge;
+
+			// uniform in the triangle between the center and one edge
+			float a = std::sqrt(Xi.y);
+			float b = a * u;
+			a -= b;
+
+			float phi0 = edge * (2 * PI / corners);
+			float phi1 = phi0 + 2 * PI / corners;
+
+			return RadeonRays::float2(
+				a * std::cos(phi0) + b * std::cos(phi1),
+				a * std::sin(phi0) + b * std::sin(phi1));
+		}
+
 		inline RadeonRays::float3 ImportanceSampleGGX(const RadeonRays::float2& Xi, float roughness)
 		{
 			float m = roughness * roughness;
@@ -198,6 +242,67 @@ namespace octoon
 			return H;
 		}
 
+		inline RadeonRays::float3 TransformPoint(const RadeonRays::float3& p, const RadeonRays::matrix& m)
+		{
+			return RadeonRays::float3(
+				p.x * m.m00 + p.y * m.m10 + p.z * m.m20 + m.m30,
+				p.x * m.m01 + p.y * m.m11 + p.z * m.m21 + m.m31,
+				p.x * m.m02 + p.y * m.m12 + p.z * m.m22 + m.m32);
+		}
+
+		inline RadeonRays::float3 TransformVector(const RadeonRays::float3& v, const RadeonRays::matrix& m)
+		{
+			return RadeonRays::float3(
+				v.x * m.m00 + v.y * m.m10 + v.z * m.m20,
+				v.x * m.m01 + v.y * m.m11 + v.z * m.m21,
+				v.x * m.m02 + v.y * m.m12 + v.z * m.m22);
+		}
+
+		inline RadeonRays::float3 TransformNormal(const RadeonRays::float3& n, const RadeonRays::matrix& minv)
+		{
+			return RadeonRays::normalize(RadeonRays::float3(
+				n.x * minv.m00 + n.y * minv.m01 + n.z * minv.m02,
+				n.x * minv.m10 + n.y * minv.m11 + n.z * minv.m12,
+				n.x * minv.m20 + n.y * minv.m21 + n.z * minv.m22));
+		}
+
+		// Element-wise blend of two affine transforms, a transformed point then moves on a straight line
+		// so the bounds at both ends enclose it for every t.
+		inline RadeonRays::matrix InterpolateTransform(const RadeonRays::matrix& m0, const RadeonRays::matrix& m1, float t)
+		{
+			RadeonRays::matrix m;
+			for (int i = 0; i < 4; i++)
+				for (int j = 0; j < 4; j++)
+					m.m[i][j] = lerp(m0.m[i][j], m1.m[i][j], t);
+			return m;
+		}
+
+		inline RadeonRays::matrix AffineInverse(const RadeonRays::matrix& m)
+		{
+			float c00 = m.m11 * m.m22 - m.m12 * m.m21;
+			float c01 = m.m12 * m.m20 - m.m10 * m.m22;
+			float c02 = m.m10 * m.m21 - m.m11 * m.m20;
+
+			float invDet = 1.0f / (m.m00 * c00 + m.m01 * c01 + m.m02 * c02);
+
+			RadeonRays::matrix r;
+			r.m00 = c00 * invDet;
+			r.m01 = (m.m02 * m.m21 - m.m01 * m.m22) * invDet;
+			r.m02 = (m.m01 * m.m12 - m.m02 * m.m11) * invDet;
+			r.m10 = c01 * invDet;
+			r.m11 = (m.m00 * m.m22 - m.m02 * m.m20) * invDet;
+			r.m12 = (m.m02 * m.m10 - m.m00 * m.m12) * invDet;
+			r.m20 = c02 * invDet;
+			r.m21 = (m.m01 * m.m20 - m.m00 * m.m21) * invDet;
+			r.m22 = (m.m00 * m.m11 - m.m01 * m.m10) * invDet;
+			r.m03 = r.m13 = r.m23 = 0.0f;
+			r.m30 = -(m.m30 * r.m00 + m.m31 * r.m10 + m.m32 * r.m20);
+			r.m31 = -(m.m30 * r.m01 + m.m31 * r.m11 + m.m32 * r.m21);
+			r.m32 = -(m.m30 * r.m02 + m.m31 * r.m12 + m.m32 * r.m22);
+			r.m33 = 1.0f;
+			return r;
+		}
+
 		inline RadeonRays::float3 TangentToWorld(const RadeonRays::float3& H, const RadeonRays::float3& N)
 		{
 			RadeonRays::float3 Y = std::abs(N.z) < 0.999f ? RadeonRays::float3(0, 0, 1) : RadeonRays::float3(1, 0, 0);
@@ -0,0 +1,112 @@
+#ifndef OCTOON_CAUSTIC_MESH_H_
+#define OCTOON_CAUSTIC_MESH_H_
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <radeon_rays.h>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		class Mesh
+		{
+		public:
+			std::vector<float> positions;
+			std::vector<float> normals;
+			std::vector<float> texcoords;
+			std::vector<std::int32_t> indices;
+
+			// Compressed shading streams, a stream replaces its float counterpart once compress() has run.
+			// Normals are octahedral encoded into 2x16 bits, texcoords and (optionally) positions are
+			// 16 bit fixed point relative to their bounds.
+			std::vector<std::uint32_t> packedNormals;
+			std::vector<std::uint16_t> packedTexcoords;
+			std::vector<std::uint16_t> packedPositions;
+
+			RadeonRays::float3 positionMin;
+			RadeonRays::float3 positionScale;
+			RadeonRays::float2 texcoordMin;
+			RadeonRays::float2 texcoordScale;
+
+			// Bumped whenever the vertices are edited in place, see Geometry::updateMesh().
+			std::uint32_t revision = 0;
+
+		public:
+			void compress(bool quantizePositions = false) noexcept;
+			void decompress() noexcept;
+
+			void getPositions(std::vector<float>& positions) const noexcept;
+
+			std::size_t getNumVertices() const noexcept
+			{
+				return packedPositions.empty() ? positions.size() / 3 : packedPositions.size() / 3;
+			}
+
+			std::size_t getNumTriangles() const noexcept
+			{
+				return indices.size() / 3;
+			}
+
+			std::size_t getMemorySize() const noexcept
+			{
+				return
+					positions.size() * sizeof(float) +
+					normals.size() * sizeof(float) +
+					texcoords.size() * sizeof(float) +
+					indices.size() * sizeof(std::int32_t) +
+					packedNormals.size() * sizeof(std::uint32_t) +
+					packedTexcoords.size() * sizeof(std::uint16_t) +
+					packedPositions.size() * sizeof(std::uint16_t);
+			}
+
+			RadeonRays::float3 getPosition(std::int32_t i) const noexcept
+			{
+				if (packedPositions.empty())
+					return RadeonRays::float3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+
+				return RadeonRays::float3(
+					positionMin.x + packedPositions[i * 3] * positionScale.x,
+					positionMin.y + packedPositions[i * 3 + 1] * positionScale.y,
+					positionMin.z + packedPositions[i * 3 + 2] * positionScale.z);
+			}
+
+			RadeonRays::float3 getNormal(std::int32_t i) const noexcept
+			{
+				if (packedNormals.empty())
+					return RadeonRays::float3(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+
+				return decodeNormal(packedNormals[i]);
+			}
+
+			RadeonRays::float2 getTexcoord(std::int32_t i) const noexcept
+			{
+				if (packedTexcoords.empty())
+					return RadeonRays::float2(texcoords[i * 2], texcoords[i * 2 + 1]);
+
+				return RadeonRays::float2(
+					texcoordMin.x + packedTexcoords[i * 2] * texcoordScale.x,
+					texcoordMin.y + packedTexcoords[i * 2 + 1] * texcoordScale.y);
+			}
+
+			static std::uint32_t encodeNormal(const RadeonRays::float3& n) noexcept;
+
+			static RadeonRays::float3 decodeNormal(std::uint32_t packed) noexcept
+			{
+				float x = (packed & 0xFFFF) * (2.0f / 65535.0f) - 1.0f;
+				float y = (packed >> 16) * (2.0f / 65535.0f) - 1.0f;
+				float z = 1.0f - std::abs(x) - std::abs(y);
+				float t = std::max(-z, 0.0f);
+
+				x += x >= 0.0f ? -t : t;
+				y += y >= 0.0f ? -t : t;
+
+				return RadeonRays::normalize(RadeonRays::float3(x, y, z));
+			}
+		};
+	}
+}
+
+#endif
\ No newline at end of file
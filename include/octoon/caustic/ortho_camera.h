@@ -13,9 +13,18 @@ namespace octoon
 			OrthoCamera() noexcept;
 			virtual ~OrthoCamera() noexcept;
 
+			// Visible extent in the local xy plane as (left, right, bottom, top).
+			void setOrtho(const RadeonRays::float4& ortho) noexcept;
+			const RadeonRays::float4& getOrtho() const noexcept;
+
+			void generateRays(const RadeonRays::int2& resolution, const RadeonRays::int2& offset, const RadeonRays::int2& size, const RadeonRays::float2* random, const RadeonRays::float2* lens, const float* times, RadeonRays::ray* rays) const noexcept override;
+
 		private:
 			OrthoCamera(const OrthoCamera&) noexcept = delete;
 			OrthoCamera& operator=(const OrthoCamera&) noexcept = delete;
+
+		private:
+			RadeonRays::float4 ortho_;
 		};
 	}
 }
@@ -7,15 +7,50 @@ namespace octoon
 {
 	namespace caustic
 	{
+		// Where the pipeline traces its rays, RadeonRays on an OpenCL device or the built-in CPU BVH.
+		enum class TraversalBackend
+		{
+			RadeonRays,
+			Native
+		};
+
+		// builds without RadeonRays (OCTOON_BUILD_RADEON_RAYS off) only have the native backend
+#if defined(OCTOON_BUILD_RADEON_RAYS)
+		constexpr TraversalBackend kDefaultTraversalBackend = TraversalBackend::RadeonRays;
+#else
+		constexpr TraversalBackend kDefaultTraversalBackend = TraversalBackend::Native;
+#endif
+
+		// Acceleration structure of the last scene commit. The native backend builds one bottom level per mesh
+		// and a top level over the shapes, the bottom level fields sum over every mesh in the scene.
+		struct TraversalStats
+		{
+			std::uint32_t numShapes;
+			std::uint32_t numMeshes;
+			std::uint32_t numTriangles;
+			std::uint32_t numNodes; // both levels
+			std::uint32_t maxDepth; // top level plus the deepest bottom level
+			std::size_t memorySize; // bytes, both levels
+
+			float topLevelBuildTime; // milliseconds
+			float bottomLevelBuildTime; // milliseconds, meshes built or refit by the last commit only
+			float sahCost; // top level, in triangle tests per ray
+		};
+
 		class Pipeline
 		{
 		public:
 			Pipeline() noexcept;
 			virtual ~Pipeline() noexcept;
 
+			// Image of the first camera in the scene.
 			virtual const std::uint32_t* data() const noexcept = 0;
 
-			virtual void render(const Camera& camera, std::uint32_t frame, std::uint32_t x, std::uint32_t y, std::uint32_t w, std::uint32_t h) noexcept = 0;
+			// Renders the tile for all cameras in one batch, each accumulates into its own film.
+			virtual void render(const std::vector<Camera*>& cameras, std::uint32_t frame, std::uint32_t x, std::uint32_t y, std::uint32_t w, std::uint32_t h) noexcept = 0;
+
+			// False when the backend doesn't expose its acceleration structure.
+			virtual bool getTraversalStats(TraversalStats& stats) const noexcept;
 		};
 	}
 }
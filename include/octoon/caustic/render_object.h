@@ -28,6 +28,17 @@ namespace octoon
 			const RadeonRays::matrix& getTransform() const noexcept;
 			const RadeonRays::matrix& getTransformInverse() const noexcept;
 
+			// Transform at the end of the shutter interval, the one from setTransform() is the start.
+			// setTransform() clears it, so objects without one don't move during the exposure.
+			void setMotionTransform(const RadeonRays::matrix& m, const RadeonRays::matrix& minv) noexcept;
+			const RadeonRays::matrix& getMotionTransform() const noexcept;
+			const RadeonRays::matrix& getMotionTransformInverse() const noexcept;
+
+			bool hasMotion() const noexcept;
+
+			// Transform at a time in [0, 1] between the start and the motion transform.
+			RadeonRays::matrix getTransform(float time) const noexcept;
+
 			RadeonRays::float3 getTranslate() const noexcept;
 
 		public:
@@ -50,10 +61,12 @@ namespace octoon
 				return std::dynamic_pointer_cast<T>(this->shared_from_this());
 			}
 
-		private:
+		protected:
 			virtual void onActivate() noexcept;
 			virtual void onDeactivate() noexcept;
 
+			virtual void onMoveAfter() noexcept;
+
 		private:
 			RenderObject(const RenderObject&) = delete;
 			RenderObject& operator=(const RenderObject&) = delete;
@@ -61,11 +74,14 @@ namespace octoon
 		private:
 			bool active_;
 			bool visible_;
+			bool motion_;
 
 			std::uint8_t layer_;
 
 			RadeonRays::matrix transform_;
 			RadeonRays::matrix transformInverse_;
+			RadeonRays::matrix motionTransform_;
+			RadeonRays::matrix motionTransformInverse_;
 		};
 	}
 }
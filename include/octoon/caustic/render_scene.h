@@ -1,12 +1,15 @@
 #ifndef OCTOON_CAUSTIC_SCENE_H_
 #define OCTOON_CAUSTIC_SCENE_H_
 
+#include <mutex>
+
 #include <octoon/caustic/camera.h>
 #include <octoon/caustic/light.h>
 #include <octoon/caustic/geometry.h>
 
 namespace RadeonRays
 {
+	class Shape;
 	class IntersectionApi;
 }
 
@@ -30,6 +33,8 @@ namespace octoon
 			bool setup() noexcept;
 			void close() noexcept;
 
+			// The lists are changed under the scene lock, so objects may be activated from several loader
+			// threads. The returned lists are read without it, by the pipelines between changes.
 			void addCamera(const CameraPtr& camera) noexcept;
 			void removeCamera(const CameraPtr& camera) noexcept;
 			const std::vector<CameraPtr>& getCameraList() const noexcept;
@@ -42,10 +47,40 @@ namespace octoon
 			void removeRenderObject(const RenderObjectPtr& object) noexcept;
 			const std::vector<RenderObjectPtr>& getRenderObjects() const noexcept;
 
+			// Shape ids are dense, a pipeline can index its per-shape data with Intersection::shapeid.
+			std::int32_t getShapeCount() const noexcept;
+
+			// Bumped by every commit and material change, so pipelines with their own acceleration structure
+			// or shape data know when to rebuild.
+			std::uint32_t getRevision() const noexcept;
+
+			// Shape changes between beginUpdate() and the matching endUpdate() are committed once,
+			// updates may be nested and issued from several loader threads.
+			void beginUpdate() noexcept;
+			void endUpdate() noexcept;
+
+			RadeonRays::IntersectionApi* getIntersectionApi() const noexcept;
+
 		private:
 			friend class Geometry;
+			friend class GeometryInstance;
 			friend class RenderObject;
-			RadeonRays::IntersectionApi* getIntersectionApi() const noexcept;
+
+			RadeonRays::Shape* createMesh(const float* vertices, int vnum, int vstride, const int* indices, int istride, const int* numfacevertices, int numfaces, std::int32_t id) noexcept;
+			RadeonRays::Shape* createInstance(const RadeonRays::Shape* shape, std::int32_t id) noexcept;
+			void deleteShape(const RadeonRays::Shape* shape) noexcept;
+
+			void attachShape(const RadeonRays::Shape* shape) noexcept;
+			void detachShape(const RadeonRays::Shape* shape) noexcept;
+
+			void setShapeTransform(RadeonRays::Shape* shape, const RadeonRays::matrix& m, const RadeonRays::matrix& minv) noexcept;
+
+			void commit() noexcept;
+			// shading only changes, nothing is committed to the device
+			void touch() noexcept;
+
+			std::int32_t allocShapeId() noexcept;
+			void freeShapeId(std::int32_t id) noexcept;
 
 		private:
 			RenderScene(const RenderScene&) = delete;
@@ -54,6 +89,14 @@ namespace octoon
 		private:
 			RadeonRays::IntersectionApi* api_;
 
+			bool dirty_;
+			std::int32_t updateCount_;
+			std::uint32_t revision_;
+			std::mutex lock_;
+
+			std::int32_t shapeCount_;
+			std::vector<std::int32_t> freeShapeIds_;
+
 			std::vector<CameraPtr> cameras_;
 			std::vector<LightPtr> lights_;
 			std::vector<RenderObjectPtr> renderables_;
@@ -3,14 +3,52 @@
 
 #include <future>
 #include <queue>
+#include <deque>
 #include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <atomic>
 
 #include <octoon/caustic/pipeline.h>
+#include <octoon/caustic/denoiser.h>
+#include <octoon/caustic/tonemapping.h>
 
 namespace octoon
 {
 	namespace caustic
 	{
+		// Pixels x, y to x + w, y + h of the image, rows from the bottom up.
+		struct PreviewRect
+		{
+			std::uint32_t x;
+			std::uint32_t y;
+			std::uint32_t w;
+			std::uint32_t h;
+		};
+
+		// Order render() queues the tiles of a frame in. Morton and Hilbert keep consecutive tiles close, so
+		// they share cache lines and BVH nodes, Spiral starts in the center where a viewer looks first.
+		enum class TileOrder
+		{
+			RowMajor,
+			Morton,
+			Hilbert,
+			Spiral
+		};
+
+		// A finished tile in the order the workers finished them, tile counts row by row over the tile grid.
+		struct TileCompletion
+		{
+			std::uint32_t frame;
+			std::uint32_t tile;
+		};
+
+		template<typename T>
+		class MPSCQueue;
+		template<typename T>
+		struct MPSCQueueNode;
+		class Socket;
+
 		class System
 		{
 		public:
@@ -19,7 +57,8 @@ namespace octoon
 			System(std::uint32_t w, std::uint32_t h, std::uint32_t tileWidth, std::uint32_t tileHeight) noexcept;
 			~System() noexcept;
 
-			void setup(std::uint32_t w, std::uint32_t h) noexcept(false);
+			// The native backend traces on the host and never touches OpenCL, for CPU-only render nodes.
+			void setup(std::uint32_t w, std::uint32_t h, TraversalBackend backend = kDefaultTraversalBackend) noexcept(false);
 
 			void setTileWidth(std::uint32_t w) noexcept;
 			void setTileHeight(std::uint32_t h) noexcept;
@@ -27,30 +66,212 @@ namespace octoon
 			std::uint32_t getTileWidth() const noexcept;
 			std::uint32_t getTileHeight() const noexcept;
 
-			const std::uint32_t* data() const noexcept { return pipeline_->data(); };
+			// Sizes the tiles so every wavefront keeps all cores busy while a frame still splits into
+			// enough tiles for a responsive preview.
+			void setTileSizeAuto() noexcept;
+
+			void setTileOrder(TileOrder order) noexcept;
+			TileOrder getTileOrder() const noexcept;
+
+			// Worker groups with their own thread, pipeline and workspace, zero means one per NUMA node. Each
+			// renders a band of rows, so the film rows it writes stay on its node. Set before setup() the
+			// films are also first touched by the group owning them, later calls only move the workers and
+			// must not happen while frames are queued. The RadeonRays backend always runs a single group.
+			void setWorkerGroups(std::uint32_t count) noexcept;
+			std::uint32_t getWorkerGroups() const noexcept;
+
+			// Pins the threads of every group, including its OpenMP team, to the processors of its node.
+			void setThreadPinning(bool enable) noexcept;
+			bool getThreadPinning() const noexcept;
+
+			// Acceleration structure the first group traced its last tile with, every group builds the same.
+			// False before setup() or with a backend that doesn't report its structure.
+			bool getTraversalStats(TraversalStats& stats) const noexcept;
+
+			// With denoising, data() returns the filtered image of the first camera instead of the noisy accumulation.
+			const std::uint32_t* data() const noexcept;
+
+			void setDenoise(bool enable) noexcept;
+			bool getDenoise() const noexcept;
+
+			// The filter touches the whole image, so it isn't run for every frame. resolvePreview() filters once
+			// interval frames completed since the last filter, denoise() filters on demand, e.g. after wait_all().
+			void setDenoiseInterval(std::uint32_t frames) noexcept;
+			std::uint32_t getDenoiseInterval() const noexcept;
+
+			Denoiser& getDenoiser() noexcept;
+			void denoise() noexcept;
+
+			// Collects the regions of data() that changed since the previous resolve, so a viewer uploads
+			// only those. Returns false and leaves rects alone until the interval has passed since the last
+			// resolve that returned true, a viewer can call it after every wait_one(). Flush ignores the
+			// interval, for the tail of a frame or the job that no later wait_one() would pick up.
+			bool resolvePreview(std::vector<PreviewRect>& rects, bool flush = false) noexcept;
+
+			void setPreviewInterval(std::uint32_t milliseconds) noexcept;
+			std::uint32_t getPreviewInterval() const noexcept;
+
+			// Every interval frames, once the frame has completed in wait_one(), the accumulation of all
+			// cameras and the frame index are written to path. An interval of zero disables checkpoints.
+			void setCheckpoint(const std::string& path, std::uint32_t interval) noexcept;
+
+			bool saveCheckpoint(const std::string& path, std::uint32_t frame) noexcept;
+			// Restores the films of the scene cameras, returns the frame to continue after or 0 without a usable checkpoint.
+			std::uint32_t loadCheckpoint(const std::string& path) noexcept;
+
+			// Frames render() may have queued before wait_one() asks for the next one. With more than one
+			// the worker moves on to the tiles of the next frame while the viewer still drains the last,
+			// instead of idling at every frame boundary. Frames that save a checkpoint still drain fully.
+			void setFramesInFlight(std::uint32_t frames) noexcept;
+			std::uint32_t getFramesInFlight() const noexcept;
 
+			// Waits for whichever queued tile finishes first, returns true as long as the caller should
+			// keep waiting before submitting the next frame. Called from the thread that queues the work.
 			bool wait_one() noexcept;
+			bool wait_one(TileCompletion& completion) noexcept;
+			// Takes the next finished tile without blocking, false while none is ready.
+			bool poll_one(TileCompletion& completion) noexcept;
+			// Waits until every queued frame has completed.
+			void wait_all() noexcept;
+
+			// Samples each tile of render() accumulates in one go, render(frame) then draws the sample indices
+			// frame * spp to frame * spp + spp - 1. More per tile amortizes the round trip to a render node.
+			// Frames and checkpoints still count render() calls, so keep spp fixed when resuming a checkpoint.
+			// Clamped to 4096, the most a render node accepts per item.
+			void setSamplesPerTile(std::uint32_t spp) noexcept;
+			std::uint32_t getSamplesPerTile() const noexcept;
+
+			// Coordinator: accepts render nodes on port, render() then hands its tiles out as work items and
+			// merges the returned tiles into the films. The local worker keeps taking tiles as well.
+			bool listen(std::uint16_t port) noexcept;
+			std::uint32_t getWorkerCount() const noexcept;
+
+			// How long the coordinator waits on a render node before it drops the node and requeues its item,
+			// so must exceed the time a node needs for one item. Applies to nodes accepted afterwards.
+			void setWorkerTimeout(std::uint32_t milliseconds) noexcept;
+			std::uint32_t getWorkerTimeout() const noexcept;
+
+			// Render node: serves the work items of the coordinator at host and port until it disconnects.
+			// Both ends need the same scene, cameras and resolution.
+			bool work(const std::string& host, std::uint16_t port) noexcept;
 
 			void render(std::uint32_t frame) noexcept;
 			std::future<std::uint32_t> renderTile(std::uint32_t frame, std::uint32_t tile) noexcept;
 			std::future<std::uint32_t> renderFullscreen(std::uint32_t frame) noexcept;
 
 		private:
-			void thread() noexcept;
+			struct WorkItem
+			{
+				std::uint32_t frame;
+				std::uint32_t tile;
+				std::uint32_t spp;
+				// taken from the completion pool by the thread queueing the item, so workers never allocate
+				MPSCQueueNode<TileCompletion>* completion;
+			};
+
+			struct WorkerGroup
+			{
+				std::vector<std::uint32_t> cpus;
+				std::unique_ptr<Pipeline> pipeline;
+
+				std::atomic<bool> quit;
+				std::thread thread;
+				std::mutex lock;
+				std::condition_variable signal;
+				std::queue<std::packaged_task<std::uint32_t()>> tasks;
+			};
+
+			PreviewRect getTileRect(std::uint32_t tile) const noexcept;
+
+			void startGroups(bool firstTouch) noexcept;
+			void stopGroups() noexcept;
+			WorkerGroup& getTileGroup(std::uint32_t tile) const noexcept;
+
+			std::future<std::uint32_t> submit(const WorkItem& item) noexcept;
+			void renderTileLocal(Pipeline& pipeline, const WorkItem& item) noexcept;
+
+			bool popItem(WorkItem& item, bool wait) noexcept;
+			void requeueItem(const WorkItem& item) noexcept;
+			void mergeTile(const WorkItem& item, std::vector<FilmTile>& tiles) noexcept;
+
+			void accept() noexcept;
+			void serve(std::shared_ptr<Socket> socket) noexcept;
+
+			void markDirty(const PreviewRect& rect) noexcept;
+			void buildTileOrder(std::uint32_t w, std::uint32_t h) noexcept;
+			void onTileComplete(MPSCQueueNode<TileCompletion>* node, const TileCompletion& completion) noexcept;
+			void retire(const TileCompletion& completion) noexcept;
+			void onFrameComplete(std::uint32_t frame) noexcept;
+			bool isFrameBlocking() const noexcept;
+
+			void loadObj(const std::string& filename, const std::string& basepath) noexcept(false);
+
+			bool popTask(WorkerGroup& group, std::packaged_task<std::uint32_t()>& task) noexcept;
+			void pushTask(WorkerGroup& group, std::packaged_task<std::uint32_t()>&& task) noexcept;
+
+			void thread(WorkerGroup& group, std::uint32_t index, bool firstTouch, std::promise<void>& ready) noexcept;
 
 		private:
 			std::uint32_t width_;
 			std::uint32_t height_;
-			std::unique_ptr<Pipeline> pipeline_;
+			TraversalBackend backend_;
+			std::vector<std::shared_ptr<Geometry>> geometries_;
 
 			std::int32_t tileWidth_;
 			std::int32_t tileHeight_;
+			TileOrder tileOrder_;
+			// tile indices in the queue order, rebuilt when the grid or the order changes
+			std::vector<std::uint32_t> tiles_;
+			std::uint32_t tilesX_;
+			std::uint32_t tilesY_;
+
+			std::uint32_t frame_;
+			std::uint32_t framesInFlight_;
+			// frames queued by render() with their outstanding tiles
+			std::deque<std::pair<std::uint32_t, std::uint32_t>> frames_;
+			std::uint32_t checkpointInterval_;
+			std::string checkpointPath_;
+
+			bool denoise_;
+			std::uint32_t denoiseInterval_;
+			// frames completed since the last filter
+			std::uint32_t denoiseFrames_;
+			Denoiser denoiser_;
+			std::unique_ptr<Tonemapping> tonemapping_;
+			std::vector<RadeonRays::float3> denoised_;
+			std::vector<std::uint32_t> preview_;
+
+			std::mutex dirtyLock_;
+			std::vector<PreviewRect> dirty_;
+			std::uint32_t previewInterval_;
+			std::chrono::steady_clock::time_point previewTime_;
+
+			std::atomic<bool> isQuitRequest_;
+
+			std::uint32_t groupCount_;
+			bool threadPinning_;
+			std::vector<std::unique_ptr<WorkerGroup>> groups_;
+
+			// tiles are posted by the workers as they finish, pending counts the ones not taken yet
+			std::uint32_t pending_;
+			std::unique_ptr<MPSCQueue<TileCompletion>> completions_;
+			std::mutex completionLock_;
+			std::condition_variable completionSignal_;
+
+			std::uint32_t samplesPerTile_;
 
-			bool isQuitRequest_;
-			std::mutex lock_;
-			std::thread thread_;
-			std::queue<std::packaged_task<std::uint32_t()>> task_;
-			std::vector<std::future<std::uint32_t>> queues_;
+			// work items waiting for the local worker or a render node
+			std::unique_ptr<Socket> listener_;
+			std::thread acceptThread_;
+			std::vector<std::thread> connections_;
+			std::vector<std::shared_ptr<Socket>> sockets_;
+			std::atomic<std::uint32_t> workerCount_;
+			std::atomic<std::uint32_t> workerTimeout_;
+			// set once listen() succeeded, the groups then take work from items_
+			std::atomic<bool> listening_;
+			std::mutex itemsLock_;
+			std::condition_variable itemsSignal_;
+			std::deque<WorkItem> items_;
 		};
 	}
 }
@@ -0,0 +1,123 @@
+#include "arena.h"
+
+#if defined(_WIN32)
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#endif
+
+#include <new>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		constexpr std::size_t kHugePageSize = 2 << 20;
+
+#if defined(_WIN32)
+		void* AllocatePages(std::size_t& size) noexcept
+		{
+			// large pages need the lock memory privilege, most accounts fall back to regular ones
+			auto largePage = ::GetLargePageMinimum();
+			if (largePage && size >= largePage)
+			{
+				auto large = (size + largePage - 1) & ~(largePage - 1);
+				auto data = ::VirtualAlloc(nullptr, large, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+				if (data)
+				{
+					size = large;
+					return data;
+				}
+			}
+
+			return ::VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		}
+
+		void FreePages(void* data, std::size_t size) noexcept
+		{
+			::VirtualFree(data, 0, MEM_RELEASE);
+		}
+#else
+		void* AllocatePages(std::size_t& size) noexcept
+		{
+			if (size >= kHugePageSize)
+				size = (size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+
+			auto data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (data == MAP_FAILED)
+				return nullptr;
+
+			// only a hint, transparent huge pages may be disabled
+#	if defined(MADV_HUGEPAGE)
+			if (size >= kHugePageSize)
+				::madvise(data, size, MADV_HUGEPAGE);
+#	endif
+
+			return data;
+		}
+
+		void FreePages(void* data, std::size_t size) noexcept
+		{
+			::munmap(data, size);
+		}
+#endif
+
+		Arena::Arena() noexcept
+			: data_(nullptr)
+			, offset_(0)
+			, capacity_(0)
+		{
+		}
+
+		Arena::~Arena() noexcept
+		{
+			if (data_)
+				FreePages(data_, capacity_);
+		}
+
+		void
+		Arena::reserve(std::size_t size) noexcept(false)
+		{
+			offset_ = 0;
+
+			if (size <= capacity_)
+				return;
+
+			if (data_)
+				FreePages(data_, capacity_);
+
+			// untouched until the loops of the first tile write them, so they land on the nodes of its threads
+			auto data = AllocatePages(size);
+			if (!data)
+			{
+				data_ = nullptr;
+				capacity_ = 0;
+				throw std::bad_alloc();
+			}
+
+			data_ = (char*)data;
+			capacity_ = size;
+		}
+
+		void
+		Arena::reset() noexcept
+		{
+			offset_ = 0;
+		}
+
+		std::size_t
+		Arena::size() const noexcept
+		{
+			return offset_;
+		}
+
+		std::size_t
+		Arena::capacity() const noexcept
+		{
+			return capacity_;
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef OCTOON_CAUSTIC_ARENA_H_
+#define OCTOON_CAUSTIC_ARENA_H_
+
+#include <cstddef>
+#include <cassert>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		// Bump allocator over one block of page backed memory, huge pages where the system offers them.
+		// Arrays are carved uninitialized and cache line aligned, reset() drops all of them at once.
+		class Arena final
+		{
+		public:
+			static constexpr std::size_t kAlignment = 64;
+
+			Arena() noexcept;
+			~Arena() noexcept;
+
+			// Drops everything carved, the block is only replaced when size bytes don't fit.
+			void reserve(std::size_t size) noexcept(false);
+			void reset() noexcept;
+
+			std::size_t size() const noexcept;
+			std::size_t capacity() const noexcept;
+
+			template<typename T>
+			T* allocate(std::size_t count) noexcept
+			{
+				assert(offset_ + sizeOf<T>(count) <= capacity_);
+
+				auto data = (T*)(data_ + offset_);
+				offset_ += sizeOf<T>(count);
+				return data;
+			}
+
+			// Bytes taken by count elements, including the padding to the next array.
+			template<typename T>
+			static std::size_t sizeOf(std::size_t count) noexcept
+			{
+				return (sizeof(T) * count + kAlignment - 1) & ~(kAlignment - 1);
+			}
+
+		private:
+			Arena(const Arena&) = delete;
+			Arena& operator=(const Arena&) = delete;
+
+		private:
+			char* data_;
+			std::size_t offset_;
+			std::size_t capacity_;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,1083 @@
+#include "bvh.h"
+#include <octoon/caustic/math.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <numeric>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define OCTOON_CAUSTIC_BVH_SSE 1
+#endif
+
+namespace octoon
+{
+	namespace caustic
+	{
+		namespace
+		{
+			constexpr std::int32_t kNumBins = 16;
+			constexpr std::int32_t kMaxLeafSize = 4;
+			constexpr std::int32_t kStackSize = 256;
+
+			// below this depth ranges are split at the middle, so a binary tree over 2^31 primitives is at most
+			// kMaxSahDepth + 31 deep and a four wide traversal pushes at most three entries per level
+			constexpr std::int32_t kMaxSahDepth = 48;
+			static_assert(3 * (kMaxSahDepth + 31) + 1 <= kStackSize, "traversal stack too small for the build depth");
+
+			// ranges above these sizes are split into tasks / binned by several threads
+			constexpr std::int32_t kParallelTaskSize = 4096;
+			constexpr std::int32_t kParallelBinSize = 65536;
+
+			constexpr float kTraversalCost = 1.0f;
+			constexpr float kIntersectionCost = 1.0f;
+
+			// leafs are intersected four triangles at a time, so the SAH counts blocks instead of triangles
+			constexpr std::int32_t Blocks(std::int32_t count) noexcept
+			{
+				return (count + 3) / 4;
+			}
+
+			struct alignas(16) Box4
+			{
+				float min[4];
+				float max[4];
+
+				void reset() noexcept
+				{
+					for (int i = 0; i < 4; i++)
+					{
+						min[i] = FLT_MAX;
+						max[i] = -FLT_MAX;
+					}
+				}
+
+				void grow(const Box4& box) noexcept
+				{
+#if OCTOON_CAUSTIC_BVH_SSE
+					_mm_store_ps(min, _mm_min_ps(_mm_load_ps(min), _mm_load_ps(box.min)));
+					_mm_store_ps(max, _mm_max_ps(_mm_load_ps(max), _mm_load_ps(box.max)));
+#else
+					for (int i = 0; i < 4; i++)
+					{
+						min[i] = std::min(min[i], box.min[i]);
+						max[i] = std::max(max[i], box.max[i]);
+					}
+#endif
+				}
+
+				void grow(const float p[4]) noexcept
+				{
+					for (int i = 0; i < 4; i++)
+					{
+						min[i] = std::min(min[i], p[i]);
+						max[i] = std::max(max[i], p[i]);
+					}
+				}
+
+				void center(float p[4]) const noexcept
+				{
+					for (int i = 0; i < 4; i++)
+						p[i] = (min[i] + max[i]) * 0.5f;
+				}
+
+				float area() const noexcept
+				{
+					if (min[0] > max[0])
+						return 0.0f;
+
+					float x = max[0] - min[0];
+					float y = max[1] - min[1];
+					float z = max[2] - min[2];
+					return 2.0f * (x * y + y * z + z * x);
+				}
+			};
+
+			struct Bins
+			{
+				Box4 bounds[3][kNumBins];
+				std::int32_t count[3][kNumBins];
+
+				void reset() noexcept
+				{
+					for (int axis = 0; axis < 3; axis++)
+					{
+						for (int i = 0; i < kNumBins; i++)
+						{
+							bounds[axis][i].reset();
+							count[axis][i] = 0;
+						}
+					}
+				}
+
+				void merge(const Bins& bins) noexcept
+				{
+					for (int axis = 0; axis < 3; axis++)
+					{
+						for (int i = 0; i < kNumBins; i++)
+						{
+							bounds[axis][i].grow(bins.bounds[axis][i]);
+							count[axis][i] += bins.count[axis][i];
+						}
+					}
+				}
+			};
+
+			// Bins all three axes in one pass, the bin indices of an axis triple come from one vector op.
+			void BinPrimitives(Bins& bins, const Box4* boxes, const std::int32_t* prims, std::int32_t count, const float origin[4], const float scale[4]) noexcept
+			{
+#if OCTOON_CAUSTIC_BVH_SSE
+				auto vorigin = _mm_loadu_ps(origin);
+				auto vscale = _mm_loadu_ps(scale);
+				auto vhalf = _mm_set1_ps(0.5f);
+
+				alignas(16) std::int32_t index[4];
+
+				for (std::int32_t i = 0; i < count; i++)
+				{
+					auto& box = boxes[prims[i]];
+					auto bmin = _mm_load_ps(box.min);
+					auto bmax = _mm_load_ps(box.max);
+					auto center = _mm_mul_ps(_mm_add_ps(bmin, bmax), vhalf);
+
+					_mm_store_si128((__m128i*)index, _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(center, vorigin), vscale)));
+
+					for (int axis = 0; axis < 3; axis++)
+					{
+						auto bin = std::min(std::max(index[axis], 0), kNumBins - 1);
+						auto& bounds = bins.bounds[axis][bin];
+						_mm_store_ps(bounds.min, _mm_min_ps(_mm_load_ps(bounds.min), bmin));
+						_mm_store_ps(bounds.max, _mm_max_ps(_mm_load_ps(bounds.max), bmax));
+						bins.count[axis][bin]++;
+					}
+				}
+#else
+				for (std::int32_t i = 0; i < count; i++)
+				{
+					auto& box = boxes[prims[i]];
+
+					float center[4];
+					box.center(center);
+
+					for (int axis = 0; axis < 3; axis++)
+					{
+						auto bin = std::min(std::max((std::int32_t)((center[axis] - origin[axis]) * scale[axis]), 0), kNumBins - 1);
+						bins.bounds[axis][bin].grow(box);
+						bins.count[axis][bin]++;
+					}
+				}
+#endif
+			}
+
+			// Splits [0, count) into one chunk per hardware thread and waits for all of them.
+			template<typename Func>
+			void ParallelChunks(std::int32_t count, std::int32_t numChunks, Func&& func) noexcept
+			{
+				std::vector<std::future<void>> tasks;
+
+				auto chunk = (count + numChunks - 1) / numChunks;
+				for (std::int32_t i = 1; i < numChunks; i++)
+				{
+					auto begin = std::min(i * chunk, count);
+					auto end = std::min(begin + chunk, count);
+					tasks.push_back(std::async(std::launch::async, [&func, i, begin, end]() { func(i, begin, end); }));
+				}
+
+				func(0, 0, std::min(chunk, count));
+
+				for (auto& it : tasks)
+					it.wait();
+			}
+
+			struct RayData
+			{
+				float o[3];
+				float d[3];
+				float invd[3];
+				bool cull;
+			};
+
+			RayData PrepareRay(const RadeonRays::ray& ray) noexcept
+			{
+				RayData r;
+
+				for (int i = 0; i < 3; i++)
+				{
+					float d = ray.d[i];
+					r.o[i] = ray.o[i];
+					r.d[i] = d;
+					r.invd[i] = 1.0f / (std::abs(d) > 1e-20f ? d : std::copysign(1e-20f, d));
+				}
+
+				r.cull = ray.doBackfaceCulling != 0;
+				return r;
+			}
+
+#if OCTOON_CAUSTIC_BVH_SSE
+			int IntersectBoxes(const BVHNode& node, const RayData& r, float tmax, float tnear[4]) noexcept
+			{
+				auto ox = _mm_set1_ps(r.o[0]), oy = _mm_set1_ps(r.o[1]), oz = _mm_set1_ps(r.o[2]);
+				auto ix = _mm_set1_ps(r.invd[0]), iy = _mm_set1_ps(r.invd[1]), iz = _mm_set1_ps(r.invd[2]);
+
+				auto t0x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), ox), ix);
+				auto t1x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), ox), ix);
+				auto t0y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), oy), iy);
+				auto t1y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), oy), iy);
+				auto t0z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), oz), iz);
+				auto t1z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), oz), iz);
+
+				auto tmin = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+				auto tfar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(tmax)));
+
+				_mm_storeu_ps(tnear, tmin);
+
+				return _mm_movemask_ps(_mm_cmple_ps(tmin, tfar)) & ((1 << node.numChildren) - 1);
+			}
+
+			int IntersectTriangles(const BVHTriangle4& tri, const RayData& r, float tmax, float t[4], float u[4], float v[4]) noexcept
+			{
+				auto dx = _mm_set1_ps(r.d[0]), dy = _mm_set1_ps(r.d[1]), dz = _mm_set1_ps(r.d[2]);
+				auto e1x = _mm_load_ps(tri.e1x), e1y = _mm_load_ps(tri.e1y), e1z = _mm_load_ps(tri.e1z);
+				auto e2x = _mm_load_ps(tri.e2x), e2y = _mm_load_ps(tri.e2y), e2z = _mm_load_ps(tri.e2z);
+
+				auto px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+				auto py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+				auto pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+				auto det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+				auto valid = r.cull ? _mm_cmpgt_ps(det, _mm_setzero_ps()) : _mm_cmpneq_ps(det, _mm_setzero_ps());
+				auto inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+				auto sx = _mm_sub_ps(_mm_set1_ps(r.o[0]), _mm_load_ps(tri.v0x));
+				auto sy = _mm_sub_ps(_mm_set1_ps(r.o[1]), _mm_load_ps(tri.v0y));
+				auto sz = _mm_sub_ps(_mm_set1_ps(r.o[2]), _mm_load_ps(tri.v0z));
+
+				auto uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv);
+
+				auto qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+				auto qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+				auto qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+				auto vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+				auto tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+
+				valid = _mm_and_ps(valid, _mm_cmpge_ps(uu, _mm_setzero_ps()));
+				valid = _mm_and_ps(valid, _mm_cmpge_ps(vv, _mm_setzero_ps()));
+				valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+				valid = _mm_and_ps(valid, _mm_cmpgt_ps(tt, _mm_setzero_ps()));
+				valid = _mm_and_ps(valid, _mm_cmplt_ps(tt, _mm_set1_ps(tmax)));
+
+				_mm_storeu_ps(t, tt);
+				_mm_storeu_ps(u, uu);
+				_mm_storeu_ps(v, vv);
+
+				return _mm_movemask_ps(valid);
+			}
+#else
+			int IntersectBoxes(const BVHNode& node, const RayData& r, float tmax, float tnear[4]) noexcept
+			{
+				int mask = 0;
+
+				for (int i = 0; i < node.numChildren; i++)
+				{
+					float t0x = (node.minX[i] - r.o[0]) * r.invd[0], t1x = (node.maxX[i] - r.o[0]) * r.invd[0];
+					float t0y = (node.minY[i] - r.o[1]) * r.invd[1], t1y = (node.maxY[i] - r.o[1]) * r.invd[1];
+					float t0z = (node.minZ[i] - r.o[2]) * r.invd[2], t1z = (node.maxZ[i] - r.o[2]) * r.invd[2];
+
+					float tmin = std::max(std::max(std::min(t0x, t1x), std::min(t0y, t1y)), std::max(std::min(t0z, t1z), 0.0f));
+					float tfar = std::min(std::min(std::max(t0x, t1x), std::max(t0y, t1y)), std::min(std::max(t0z, t1z), tmax));
+
+					tnear[i] = tmin;
+					if (tmin <= tfar)
+						mask |= 1 << i;
+				}
+
+				return mask;
+			}
+
+			int IntersectTriangles(const BVHTriangle4& tri, const RayData& r, float tmax, float t[4], float u[4], float v[4]) noexcept
+			{
+				int mask = 0;
+
+				for (int i = 0; i < 4; i++)
+				{
+					float px = r.d[1] * tri.e2z[i] - r.d[2] * tri.e2y[i];
+					float py = r.d[2] * tri.e2x[i] - r.d[0] * tri.e2z[i];
+					float pz = r.d[0] * tri.e2y[i] - r.d[1] * tri.e2x[i];
+
+					float det = tri.e1x[i] * px + tri.e1y[i] * py + tri.e1z[i] * pz;
+					if (r.cull ? det <= 0.0f : det == 0.0f)
+						continue;
+
+					float inv = 1.0f / det;
+					float sx = r.o[0] - tri.v0x[i];
+					float sy = r.o[1] - tri.v0y[i];
+					float sz = r.o[2] - tri.v0z[i];
+
+					u[i] = (sx * px + sy * py + sz * pz) * inv;
+
+					float qx = sy * tri.e1z[i] - sz * tri.e1y[i];
+					float qy = sz * tri.e1x[i] - sx * tri.e1z[i];
+					float qz = sx * tri.e1y[i] - sy * tri.e1x[i];
+
+					v[i] = (r.d[0] * qx + r.d[1] * qy + r.d[2] * qz) * inv;
+					t[i] = (tri.e2x[i] * qx + tri.e2y[i] * qy + tri.e2z[i] * qz) * inv;
+
+					if (u[i] >= 0.0f && v[i] >= 0.0f && u[i] + v[i] <= 1.0f && t[i] > 0.0f && t[i] < tmax)
+						mask |= 1 << i;
+				}
+
+				return mask;
+			}
+#endif
+		}
+
+		struct BVH::Builder
+		{
+			struct alignas(16) BuildNode
+			{
+				Box4 bounds;
+				std::int32_t left;
+				std::int32_t right;
+				std::int32_t begin;
+				std::int32_t count;
+			};
+
+			BVH& bvh;
+
+			// exactly one of them is set, instances build the top level of a two level hierarchy
+			const std::vector<BVHTriangle>* triangles;
+			const std::vector<BVHInstance>* instances;
+
+			std::vector<Box4, AlignedAllocator<Box4, 16>> boxes;
+			std::vector<std::int32_t> prims;
+
+			// a binary tree over n primitives never has more than 2n - 1 nodes, so tasks allocate with an atomic counter
+			std::vector<BuildNode, AlignedAllocator<BuildNode, 16>> nodes;
+			std::atomic<std::int32_t> numNodes;
+
+			std::int32_t numThreads;
+			std::int32_t maxTaskDepth;
+
+			float rootArea;
+
+			Builder(BVH& owner, std::int32_t count) noexcept
+				: bvh(owner)
+				, triangles(nullptr)
+				, instances(nullptr)
+				, boxes(count)
+				, prims(count)
+				, nodes(count * 2)
+				, numNodes(0)
+				, rootArea(0.0f)
+			{
+				numThreads = std::max<std::int32_t>(1, std::thread::hardware_concurrency());
+				maxTaskDepth = 1;
+				while ((1 << maxTaskDepth) < numThreads * 4)
+					maxTaskDepth++;
+
+				std::iota(prims.begin(), prims.end(), 0);
+			}
+
+			// a triangle leaf is tested in one go, while every instance costs a traversal of its own
+			float cost(std::int32_t count) const noexcept
+			{
+				return kIntersectionCost * (instances ? count : Blocks(count));
+			}
+
+			void computeBounds(std::int32_t begin, std::int32_t end, Box4& bounds, Box4& centerBounds) noexcept
+			{
+				auto reduce = [&](std::int32_t first, std::int32_t last, Box4& b, Box4& c)
+				{
+					b.reset();
+					c.reset();
+
+					for (std::int32_t i = first; i < last; i++)
+					{
+						float center[4];
+						boxes[prims[i]].center(center);
+
+						b.grow(boxes[prims[i]]);
+						c.grow(center);
+					}
+				};
+
+				if (end - begin < kParallelBinSize || numThreads == 1)
+				{
+					reduce(begin, end, bounds, centerBounds);
+					return;
+				}
+
+				std::vector<Box4, AlignedAllocator<Box4, 16>> partial(numThreads * 2);
+
+				ParallelChunks(end - begin, numThreads, [&](std::int32_t chunk, std::int32_t first, std::int32_t last)
+				{
+					reduce(begin + first, begin + last, partial[chunk * 2], partial[chunk * 2 + 1]);
+				});
+
+				bounds.reset();
+				centerBounds.reset();
+
+				for (std::int32_t i = 0; i < numThreads; i++)
+				{
+					bounds.grow(partial[i * 2]);
+					centerBounds.grow(partial[i * 2 + 1]);
+				}
+			}
+
+			void binning(std::int32_t begin, std::int32_t end, const float origin[4], const float scale[4], Bins& bins) noexcept
+			{
+				bins.reset();
+
+				if (end - begin < kParallelBinSize || numThreads == 1)
+				{
+					BinPrimitives(bins, boxes.data(), prims.data() + begin, end - begin, origin, scale);
+					return;
+				}
+
+				std::vector<Bins> partial(numThreads);
+
+				ParallelChunks(end - begin, numThreads, [&](std::int32_t chunk, std::int32_t first, std::int32_t last)
+				{
+					partial[chunk].reset();
+					BinPrimitives(partial[chunk], boxes.data(), prims.data() + begin + first, last - first, origin, scale);
+				});
+
+				for (auto& it : partial)
+					bins.merge(it);
+			}
+
+			std::int32_t split(std::int32_t begin, std::int32_t end, std::int32_t depth) noexcept
+			{
+				auto index = numNodes++;
+
+				auto& node = nodes[index];
+				node.left = node.right = -1;
+				node.begin = begin;
+				node.count = end - begin;
+
+				Box4 centerBounds;
+				this->computeBounds(begin, end, node.bounds, centerBounds);
+
+				if (node.count <= 1)
+					return index;
+
+				float scale[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				for (int axis = 0; axis < 3; axis++)
+				{
+					float extent = centerBounds.max[axis] - centerBounds.min[axis];
+					if (extent > 0.0f)
+						scale[axis] = kNumBins / extent;
+				}
+
+				Bins bins;
+				this->binning(begin, end, centerBounds.min, scale, bins);
+
+				float bestCost = FLT_MAX;
+				std::int32_t bestAxis = -1;
+				std::int32_t bestSplit = 0;
+
+				for (int axis = 0; axis < 3; axis++)
+				{
+					if (scale[axis] == 0.0f)
+						continue;
+
+					float rightArea[kNumBins];
+					std::int32_t rightCount[kNumBins];
+
+					Box4 box;
+					box.reset();
+
+					std::int32_t count = 0;
+					for (std::int32_t i = kNumBins - 1; i > 0; i--)
+					{
+						box.grow(bins.bounds[axis][i]);
+						count += bins.count[axis][i];
+						rightArea[i] = box.area();
+						rightCount[i] = count;
+					}
+
+					box.reset();
+					count = 0;
+
+					for (std::int32_t i = 1; i < kNumBins; i++)
+					{
+						box.grow(bins.bounds[axis][i - 1]);
+						count += bins.count[axis][i - 1];
+
+						float cost = box.area() * this->cost(count) + rightArea[i] * this->cost(rightCount[i]);
+						if (cost < bestCost)
+						{
+							bestCost = cost;
+							bestAxis = axis;
+							bestSplit = i;
+						}
+					}
+				}
+
+				float area = node.bounds.area();
+				float leafCost = this->cost(node.count) * area;
+
+				if (bestAxis >= 0)
+					bestCost = kTraversalCost * area + bestCost;
+
+				if (node.count <= kMaxLeafSize && (bestAxis < 0 || leafCost <= bestCost))
+					return index;
+
+				std::int32_t mid = begin + node.count / 2;
+
+				if (bestAxis >= 0 && depth < kMaxSahDepth)
+				{
+					auto origin = centerBounds.min[bestAxis];
+					auto k = scale[bestAxis];
+
+					auto it = std::partition(prims.begin() + begin, prims.begin() + end, [&](std::int32_t prim)
+					{
+						auto& box = boxes[prim];
+						auto center = (box.min[bestAxis] + box.max[bestAxis]) * 0.5f;
+						return std::min(std::max((std::int32_t)((center - origin) * k), 0), kNumBins - 1) < bestSplit;
+					});
+
+					auto pos = (std::int32_t)(it - prims.begin());
+					if (pos != begin && pos != end)
+						mid = pos;
+				}
+
+				std::int32_t left, right;
+
+				if (node.count >= kParallelTaskSize && depth < maxTaskDepth)
+				{
+					auto task = std::async(std::launch::async, [this, begin, mid, depth]() { return this->split(begin, mid, depth + 1); });
+					right = this->split(mid, end, depth + 1);
+					left = task.get();
+				}
+				else
+				{
+					left = this->split(begin, mid, depth + 1);
+					right = this->split(mid, end, depth + 1);
+				}
+
+				node.left = left;
+				node.right = right;
+				node.count = 0;
+
+				return index;
+			}
+
+			std::int32_t createLeaf(const BuildNode& node) noexcept
+			{
+				assert(node.count <= 4);
+
+				bvh.stats_.sahCost += this->cost(node.count) * node.bounds.area() / rootArea;
+
+				if (instances)
+				{
+					auto first = (std::int32_t)bvh.instances_.size();
+					for (std::int32_t i = 0; i < node.count; i++)
+						bvh.instances_.push_back((*instances)[prims[node.begin + i]]);
+
+					return first << 2 | (node.count - 1);
+				}
+
+				BVHTriangle4 leaf;
+				std::memset(&leaf, 0, sizeof(leaf));
+
+				for (std::int32_t i = 0; i < 4; i++)
+				{
+					leaf.shapeid[i] = RadeonRays::kNullId;
+					leaf.primid[i] = RadeonRays::kNullId;
+				}
+
+				for (std::int32_t i = 0; i < 4; i++)
+					bvh.leafPrims_.push_back(i < node.count ? prims[node.begin + i] : -1);
+
+				for (std::int32_t i = 0; i < node.count; i++)
+				{
+					auto& tri = (*triangles)[prims[node.begin + i]];
+					auto e1 = tri.v1 - tri.v0;
+					auto e2 = tri.v2 - tri.v0;
+
+					leaf.v0x[i] = tri.v0.x; leaf.v0y[i] = tri.v0.y; leaf.v0z[i] = tri.v0.z;
+					leaf.e1x[i] = e1.x; leaf.e1y[i] = e1.y; leaf.e1z[i] = e1.z;
+					leaf.e2x[i] = e2.x; leaf.e2y[i] = e2.y; leaf.e2z[i] = e2.z;
+					leaf.shapeid[i] = tri.shapeid;
+					leaf.primid[i] = tri.primid;
+				}
+
+				bvh.leafs_.push_back(leaf);
+				return (std::int32_t)bvh.leafs_.size() - 1;
+			}
+
+			std::int32_t collapse(std::int32_t index, std::uint32_t depth) noexcept
+			{
+				// pulls grandchildren up until the node is four wide, opening the child with the largest area first
+				std::int32_t children[4] = { index };
+				std::int32_t numChildren = 1;
+
+				if (nodes[index].count == 0)
+				{
+					children[0] = nodes[index].left;
+					children[1] = nodes[index].right;
+					numChildren = 2;
+
+					while (numChildren < 4)
+					{
+						std::int32_t best = -1;
+						float bestArea = -1.0f;
+
+						for (std::int32_t i = 0; i < numChildren; i++)
+						{
+							auto& child = nodes[children[i]];
+							if (child.count == 0 && child.bounds.area() > bestArea)
+							{
+								best = i;
+								bestArea = child.bounds.area();
+							}
+						}
+
+						if (best < 0)
+							break;
+
+						auto& child = nodes[children[best]];
+						children[best] = child.left;
+						children[numChildren++] = child.right;
+					}
+				}
+
+				auto result = (std::int32_t)bvh.nodes_.size();
+
+				BVHNode node;
+				std::memset(&node, 0, sizeof(node));
+				node.numChildren = numChildren;
+
+				for (std::int32_t i = 0; i < numChildren; i++)
+				{
+					auto& box = nodes[children[i]].bounds;
+					node.minX[i] = box.min[0]; node.minY[i] = box.min[1]; node.minZ[i] = box.min[2];
+					node.maxX[i] = box.max[0]; node.maxY[i] = box.max[1]; node.maxZ[i] = box.max[2];
+				}
+
+				bvh.nodes_.push_back(node);
+				bvh.stats_.sahCost += kTraversalCost * nodes[index].bounds.area() / rootArea;
+				bvh.stats_.maxDepth = std::max(bvh.stats_.maxDepth, depth);
+
+				for (std::int32_t i = 0; i < numChildren; i++)
+				{
+					auto& child = nodes[children[i]];
+					auto ref = child.count > 0 ? ~this->createLeaf(child) : this->collapse(children[i], depth + 1);
+					bvh.nodes_[result].child[i] = ref;
+				}
+
+				return result;
+			}
+		};
+
+		BVH::BVH() noexcept
+		{
+			std::memset(&stats_, 0, sizeof(stats_));
+		}
+
+		BVH::~BVH() noexcept
+		{
+		}
+
+		void
+		BVH::build(const std::vector<BVHTriangle>& triangles) noexcept
+		{
+			this->clear();
+
+			if (triangles.empty())
+				return;
+
+			auto start = std::chrono::high_resolution_clock::now();
+
+			auto count = (std::int32_t)triangles.size();
+
+			Builder builder(*this, count);
+			builder.triangles = &triangles;
+
+	#pragma omp parallel for
+			for (std::int32_t i = 0; i < count; i++)
+			{
+				auto& tri = triangles[i];
+				auto& box = builder.boxes[i];
+				box.reset();
+
+				float v[3][4] =
+				{
+					{ tri.v0.x, tri.v0.y, tri.v0.z, 0.0f },
+					{ tri.v1.x, tri.v1.y, tri.v1.z, 0.0f },
+					{ tri.v2.x, tri.v2.y, tri.v2.z, 0.0f }
+				};
+
+				box.grow(v[0]);
+				box.grow(v[1]);
+				box.grow(v[2]);
+			}
+
+			this->build(builder);
+
+			auto end = std::chrono::high_resolution_clock::now();
+
+			stats_.numTriangles = (std::uint32_t)triangles.size();
+			stats_.buildTime = std::chrono::duration<float, std::milli>(end - start).count();
+		}
+
+		void
+		BVH::build(const std::vector<BVHInstance>& instances) noexcept
+		{
+			this->clear();
+
+			auto start = std::chrono::high_resolution_clock::now();
+
+			std::vector<BVHInstance> valid;
+			for (auto& it : instances)
+			{
+				if (it.bvh && !it.bvh->empty())
+					valid.push_back(it);
+			}
+
+			if (valid.empty())
+				return;
+
+			auto count = (std::int32_t)valid.size();
+
+			Builder builder(*this, count);
+			builder.instances = &valid;
+
+			for (std::int32_t i = 0; i < count; i++)
+			{
+				auto& instance = valid[i];
+				auto& box = builder.boxes[i];
+				box.reset();
+
+				RadeonRays::float3 min, max;
+				instance.bvh->getBounds(min, max);
+
+				// the union of both end boxes bounds the motion, see InterpolateTransform
+				for (std::int32_t corner = 0; corner < 8; corner++)
+				{
+					RadeonRays::float3 p(corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z);
+					auto v = TransformPoint(p, instance.transform);
+
+					float point[4] = { v.x, v.y, v.z, 0.0f };
+					box.grow(point);
+
+					if (instance.motion)
+					{
+						v = TransformPoint(p, instance.motionTransform);
+
+						float end[4] = { v.x, v.y, v.z, 0.0f };
+						box.grow(end);
+					}
+				}
+
+				stats_.numTriangles += instance.bvh->getStats().numTriangles;
+			}
+
+			this->build(builder);
+
+			auto end = std::chrono::high_resolution_clock::now();
+			stats_.buildTime = std::chrono::duration<float, std::milli>(end - start).count();
+		}
+
+		void
+		BVH::build(Builder& builder) noexcept
+		{
+			auto root = builder.split(0, (std::int32_t)builder.prims.size(), 0);
+
+			builder.rootArea = std::max(builder.nodes[root].bounds.area(), FLT_MIN);
+
+			nodes_.reserve(builder.numNodes / 2 + 1);
+			leafs_.reserve(builder.numNodes / 2 + 1);
+
+			builder.collapse(root, 1);
+
+			auto& bounds = builder.nodes[root].bounds;
+			boundsMin_ = RadeonRays::float3(bounds.min[0], bounds.min[1], bounds.min[2]);
+			boundsMax_ = RadeonRays::float3(bounds.max[0], bounds.max[1], bounds.max[2]);
+
+			stats_.numNodes = (std::uint32_t)nodes_.size();
+			stats_.numLeafs = (std::uint32_t)(instances_.empty() ? leafs_.size() : instances_.size());
+			stats_.memorySize = nodes_.size() * sizeof(BVHNode) + leafs_.size() * sizeof(BVHTriangle4) + leafPrims_.size() * sizeof(std::int32_t) + instances_.size() * sizeof(BVHInstance);
+		}
+
+		void
+		BVH::refit(const std::vector<BVHTriangle>& triangles) noexcept
+		{
+			assert(instances_.empty());
+
+			auto start = std::chrono::high_resolution_clock::now();
+
+			auto numLeafs = (std::int32_t)leafs_.size();
+
+	#pragma omp parallel for
+			for (std::int32_t i = 0; i < numLeafs; i++)
+			{
+				auto& leaf = leafs_[i];
+
+				for (std::int32_t lane = 0; lane < 4; lane++)
+				{
+					auto prim = leafPrims_[i * 4 + lane];
+					if (prim < 0)
+						continue;
+
+					auto& tri = triangles[prim];
+					auto e1 = tri.v1 - tri.v0;
+					auto e2 = tri.v2 - tri.v0;
+
+					leaf.v0x[lane] = tri.v0.x; leaf.v0y[lane] = tri.v0.y; leaf.v0z[lane] = tri.v0.z;
+					leaf.e1x[lane] = e1.x; leaf.e1y[lane] = e1.y; leaf.e1z[lane] = e1.z;
+					leaf.e2x[lane] = e2.x; leaf.e2y[lane] = e2.y; leaf.e2z[lane] = e2.z;
+				}
+			}
+
+			// nodes are stored depth first, so every child comes after its parent
+			std::vector<Box4, AlignedAllocator<Box4, 16>> bounds(nodes_.size());
+
+			// the SAH cost of the same topology over the new bounds, normalized by the root area below
+			float sahCost = 0.0f;
+
+			for (auto n = (std::int32_t)nodes_.size() - 1; n >= 0; n--)
+			{
+				auto& node = nodes_[n];
+
+				Box4 total;
+				total.reset();
+
+				for (std::int32_t i = 0; i < node.numChildren; i++)
+				{
+					Box4 box;
+					box.reset();
+
+					if (node.child[i] >= 0)
+					{
+						box = bounds[node.child[i]];
+					}
+					else
+					{
+						auto& leaf = leafs_[~node.child[i]];
+						std::int32_t count = 0;
+
+						for (std::int32_t lane = 0; lane < 4; lane++)
+						{
+							if (leafPrims_[~node.child[i] * 4 + lane] < 0)
+								continue;
+
+							count++;
+
+							float v0[4] = { leaf.v0x[lane], leaf.v0y[lane], leaf.v0z[lane], 0.0f };
+							float v1[4] = { v0[0] + leaf.e1x[lane], v0[1] + leaf.e1y[lane], v0[2] + leaf.e1z[lane], 0.0f };
+							float v2[4] = { v0[0] + leaf.e2x[lane], v0[1] + leaf.e2y[lane], v0[2] + leaf.e2z[lane], 0.0f };
+
+							box.grow(v0);
+							box.grow(v1);
+							box.grow(v2);
+						}
+
+						sahCost += kIntersectionCost * Blocks(count) * box.area();
+					}
+
+					node.minX[i] = box.min[0]; node.minY[i] = box.min[1]; node.minZ[i] = box.min[2];
+					node.maxX[i] = box.max[0]; node.maxY[i] = box.max[1]; node.maxZ[i] = box.max[2];
+
+					total.grow(box);
+				}
+
+				bounds[n] = total;
+				sahCost += kTraversalCost * total.area();
+			}
+
+			if (!bounds.empty())
+			{
+				stats_.sahCost = sahCost / std::max(bounds[0].area(), FLT_MIN);
+				boundsMin_ = RadeonRays::float3(bounds[0].min[0], bounds[0].min[1], bounds[0].min[2]);
+				boundsMax_ = RadeonRays::float3(bounds[0].max[0], bounds[0].max[1], bounds[0].max[2]);
+			}
+
+			auto end = std::chrono::high_resolution_clock::now();
+			stats_.buildTime = std::chrono::duration<float, std::milli>(end - start).count();
+		}
+
+		void
+		BVH::clear() noexcept
+		{
+			nodes_.clear();
+			leafs_.clear();
+			leafPrims_.clear();
+			instances_.clear();
+
+			std::memset(&stats_, 0, sizeof(stats_));
+		}
+
+		bool
+		BVH::empty() const noexcept
+		{
+			return nodes_.empty();
+		}
+
+		void
+		BVH::getBounds(RadeonRays::float3& min, RadeonRays::float3& max) const noexcept
+		{
+			min = boundsMin_;
+			max = boundsMax_;
+		}
+
+		const BVHStats&
+		BVH::getStats() const noexcept
+		{
+			return stats_;
+		}
+
+		template<bool anyHit>
+		bool
+		BVH::traverse(const RadeonRays::ray& ray, RadeonRays::Intersection& hit) const noexcept
+		{
+			hit.shapeid = RadeonRays::kNullId;
+			hit.primid = RadeonRays::kNullId;
+
+			if (nodes_.empty() || !ray.IsActive())
+				return false;
+
+			auto r = PrepareRay(ray);
+			auto tmax = ray.GetMaxT();
+
+			std::int32_t stack[kStackSize];
+			std::int32_t top = 0;
+			stack[top++] = 0;
+
+			while (top > 0)
+			{
+				auto ref = stack[--top];
+				if (ref >= 0)
+				{
+					auto& node = nodes_[ref];
+
+					float tnear[4];
+					int mask = IntersectBoxes(node, r, tmax, tnear);
+					if (!mask)
+						continue;
+
+					// push far children first so the nearest one is popped next
+					std::int32_t order[4];
+					std::int32_t count = 0;
+
+					for (std::int32_t i = 0; i < 4; i++)
+					{
+						if (mask & (1 << i))
+						{
+							std::int32_t k = count++;
+							for (; k > 0 && tnear[order[k - 1]] < tnear[i]; k--)
+								order[k] = order[k - 1];
+							order[k] = i;
+						}
+					}
+
+					assert(top + count <= kStackSize);
+
+					for (std::int32_t i = 0; i < count; i++)
+						stack[top++] = node.child[order[i]];
+				}
+				else if (!instances_.empty())
+				{
+					auto first = ~ref >> 2;
+					auto count = (~ref & 3) + 1;
+
+					for (std::int32_t i = first; i < first + count; i++)
+					{
+						auto& instance = instances_[i];
+
+						RadeonRays::matrix motionInverse;
+						auto transformInverse = &instance.transformInverse;
+
+						if (instance.motion)
+						{
+							motionInverse = AffineInverse(InterpolateTransform(instance.transform, instance.motionTransform, ray.GetTime()));
+							transformInverse = &motionInverse;
+						}
+
+						// the direction is not renormalized, so distances in object space match world space
+						RadeonRays::ray local = ray;
+						local.o = TransformPoint(ray.o, *transformInverse);
+						local.d = TransformVector(ray.d, *transformInverse);
+						local.SetMaxT(tmax);
+						local.SetTime(ray.GetTime());
+
+						RadeonRays::Intersection localHit;
+						if (instance.bvh->traverse<anyHit>(local, localHit))
+						{
+							hit = localHit;
+							hit.shapeid = instance.shapeid;
+							tmax = localHit.uvwt.w;
+
+							if (anyHit)
+								return true;
+						}
+					}
+				}
+				else
+				{
+					auto& leaf = leafs_[~ref];
+
+					float t[4], u[4], v[4];
+					int mask = IntersectTriangles(leaf, r, tmax, t, u, v);
+					if (!mask)
+						continue;
+
+					std::int32_t lane = -1;
+					for (std::int32_t i = 0; i < 4; i++)
+					{
+						if ((mask & (1 << i)) && t[i] < tmax)
+						{
+							tmax = t[i];
+							lane = i;
+						}
+					}
+
+					hit.shapeid = leaf.shapeid[lane];
+					hit.primid = leaf.primid[lane];
+					hit.uvwt = RadeonRays::float4(u[lane], v[lane], 0.0f, t[lane]);
+
+					if (anyHit)
+						return true;
+				}
+			}
+
+			return hit.shapeid != RadeonRays::kNullId;
+		}
+
+		void
+		BVH::intersect(const RadeonRays::ray& ray, RadeonRays::Intersection& hit) const noexcept
+		{
+			this->traverse<false>(ray, hit);
+		}
+
+		bool
+		BVH::occluded(const RadeonRays::ray& ray) const noexcept
+		{
+			RadeonRays::Intersection hit;
+			return this->traverse<true>(ray, hit);
+		}
+
+		void
+		BVH::intersect(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) const noexcept
+		{
+	#pragma omp parallel for schedule(dynamic, 64)
+			for (std::int32_t i = 0; i < count; ++i)
+				this->traverse<false>(rays[i], hits[i]);
+		}
+
+		void
+		BVH::occluded(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) const noexcept
+		{
+	#pragma omp parallel for schedule(dynamic, 64)
+			for (std::int32_t i = 0; i < count; ++i)
+				this->traverse<true>(rays[i], hits[i]);
+		}
+	}
+}
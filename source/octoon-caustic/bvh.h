@@ -0,0 +1,177 @@
+#ifndef OCTOON_CAUSTIC_BVH_H_
+#define OCTOON_CAUSTIC_BVH_H_
+
+#include <vector>
+#include <cstdint>
+#include <radeon_rays.h>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		class BVH;
+
+		struct BVHTriangle
+		{
+			RadeonRays::float3 v0;
+			RadeonRays::float3 v1;
+			RadeonRays::float3 v2;
+
+			std::int32_t shapeid;
+			std::int32_t primid;
+		};
+
+		// Placement of a bottom level BVH in a two level hierarchy.
+		struct BVHInstance
+		{
+			const BVH* bvh;
+
+			RadeonRays::matrix transform;
+			RadeonRays::matrix transformInverse;
+
+			// With motion the instance moves from transform at ray time 0 to motionTransform at time 1.
+			RadeonRays::matrix motionTransform;
+			bool motion;
+
+			std::int32_t shapeid;
+		};
+
+		// std::allocator only guarantees alignof(std::max_align_t) before C++17.
+		template<typename T, std::size_t Alignment>
+		class AlignedAllocator
+		{
+		public:
+			typedef T value_type;
+
+			template<typename U>
+			struct rebind
+			{
+				typedef AlignedAllocator<U, Alignment> other;
+			};
+
+			AlignedAllocator() noexcept {}
+
+			template<typename U>
+			AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+			T* allocate(std::size_t n)
+			{
+				auto raw = ::operator new(n * sizeof(T) + Alignment + sizeof(void*));
+				auto addr = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*) + Alignment - 1) & ~(std::uintptr_t)(Alignment - 1);
+				reinterpret_cast<void**>(addr)[-1] = raw;
+				return reinterpret_cast<T*>(addr);
+			}
+
+			void deallocate(T* p, std::size_t) noexcept
+			{
+				::operator delete(reinterpret_cast<void**>(p)[-1]);
+			}
+
+			template<typename U>
+			bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+
+			template<typename U>
+			bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+		};
+
+		// Bounds of four children in SoA layout, so one node is tested with a single SIMD slab test.
+		// Nodes are cache line aligned and two lines wide.
+		struct alignas(64) BVHNode
+		{
+			float minX[4];
+			float minY[4];
+			float minZ[4];
+			float maxX[4];
+			float maxY[4];
+			float maxZ[4];
+
+			// >= 0 an inner node, otherwise ~index of a leaf (~(first << 2 | count - 1) over instances)
+			std::int32_t child[4];
+			std::int32_t numChildren;
+		};
+
+		// Up to four triangles of a leaf, stored as a vertex and two edges for Moller-Trumbore.
+		struct alignas(64) BVHTriangle4
+		{
+			float v0x[4], v0y[4], v0z[4];
+			float e1x[4], e1y[4], e1z[4];
+			float e2x[4], e2y[4], e2z[4];
+
+			std::int32_t shapeid[4];
+			std::int32_t primid[4];
+		};
+
+		struct BVHStats
+		{
+			std::uint32_t numTriangles;
+			std::uint32_t numNodes;
+			std::uint32_t numLeafs;
+			std::uint32_t maxDepth;
+			std::size_t memorySize;
+
+			float buildTime; // milliseconds
+			float sahCost; // expected traversal cost of a ray through the root, in triangle tests
+		};
+
+		// Four wide bounding volume hierarchy over world space triangles, built with a binned SAH
+		// and traversed on the host with SSE ray-box and ray-triangle tests (scalar elsewhere).
+		// Large builds split the top levels into parallel tasks and bin primitives in parallel.
+		//
+		// A BVH either holds triangles or, as the top level of a two level hierarchy, instances of
+		// other (bottom level) BVHs. Moving an instance only rebuilds the small top level, and a bottom
+		// level whose vertices moved can be refit in O(n) as long as its topology is unchanged.
+		class BVH final
+		{
+		public:
+			BVH() noexcept;
+			~BVH() noexcept;
+
+			void build(const std::vector<BVHTriangle>& triangles) noexcept;
+			void build(const std::vector<BVHInstance>& instances) noexcept;
+
+			// Updates the leafs and node bounds from the same triangles, in the order they were built with.
+			void refit(const std::vector<BVHTriangle>& triangles) noexcept;
+
+			void clear() noexcept;
+
+			bool empty() const noexcept;
+
+			void getBounds(RadeonRays::float3& min, RadeonRays::float3& max) const noexcept;
+
+			const BVHStats& getStats() const noexcept;
+
+			// Closest hit, the result follows RadeonRays (uvwt holds the barycentrics and the distance).
+			void intersect(const RadeonRays::ray& ray, RadeonRays::Intersection& hit) const noexcept;
+			// Any hit within the ray extent.
+			bool occluded(const RadeonRays::ray& ray) const noexcept;
+
+			void intersect(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) const noexcept;
+			void occluded(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) const noexcept;
+
+		private:
+			struct Builder;
+
+			void build(Builder& builder) noexcept;
+
+			template<bool anyHit>
+			bool traverse(const RadeonRays::ray& ray, RadeonRays::Intersection& hit) const noexcept;
+
+		private:
+			BVH(const BVH&) = delete;
+			BVH& operator=(const BVH&) = delete;
+
+		private:
+			std::vector<BVHNode, AlignedAllocator<BVHNode, 64>> nodes_;
+			std::vector<BVHTriangle4, AlignedAllocator<BVHTriangle4, 64>> leafs_;
+			std::vector<std::int32_t> leafPrims_;
+			std::vector<BVHInstance> instances_;
+
+			RadeonRays::float3 boundsMin_;
+			RadeonRays::float3 boundsMax_;
+
+			BVHStats stats_;
+		};
+	}
+}
+
+#endif
@@ -5,11 +5,45 @@ namespace octoon
 	namespace caustic
 	{
 		Camera::Camera() noexcept
+			: shutterOpen_(0.0f)
+			, shutterClose_(1.0f)
+			, film_(std::make_shared<Film>())
 		{
 		}
 
 		Camera::~Camera() noexcept
 		{
 		}
+
+		void
+		Camera::setShutter(float open, float close) noexcept
+		{
+			shutterOpen_ = open;
+			shutterClose_ = close;
+		}
+
+		float
+		Camera::getShutterOpen() const noexcept
+		{
+			return shutterOpen_;
+		}
+
+		float
+		Camera::getShutterClose() const noexcept
+		{
+			return shutterClose_;
+		}
+
+		void
+		Camera::setFilm(const std::shared_ptr<Film>& film) noexcept
+		{
+			film_ = film;
+		}
+
+		const std::shared_ptr<Film>&
+		Camera::getFilm() const noexcept
+		{
+			return film_;
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include <octoon/caustic/denoiser.h>
+#include <octoon/caustic/math.h>
+#include <algorithm>
+#include <mutex>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		// B3 spline, indexed by the distance to the center
+		constexpr float kKernel[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+		// albedo below this is treated as black, the lighting is kept as it is there
+		constexpr float kAlbedoEpsilon = 1e-3f;
+
+		Denoiser::Denoiser() noexcept
+			: iterations_(5)
+			, colorSigma_(4.0f)
+			, normalSigma_(128.0f)
+			, albedoSigma_(0.1f)
+		{
+		}
+
+		Denoiser::~Denoiser() noexcept
+		{
+		}
+
+		void
+		Denoiser::setIterations(std::uint32_t iterations) noexcept
+		{
+			iterations_ = iterations;
+		}
+
+		std::uint32_t
+		Denoiser::getIterations() const noexcept
+		{
+			return iterations_;
+		}
+
+		void
+		Denoiser::setColorSigma(float sigma) noexcept
+		{
+			colorSigma_ = sigma;
+		}
+
+		float
+		Denoiser::getColorSigma() const noexcept
+		{
+			return colorSigma_;
+		}
+
+		void
+		Denoiser::setNormalSigma(float sigma) noexcept
+		{
+			normalSigma_ = sigma;
+		}
+
+		float
+		Denoiser::getNormalSigma() const noexcept
+		{
+			return normalSigma_;
+		}
+
+		void
+		Denoiser::setAlbedoSigma(float sigma) noexcept
+		{
+			albedoSigma_ = sigma;
+		}
+
+		float
+		Denoiser::getAlbedoSigma() const noexcept
+		{
+			return albedoSigma_;
+		}
+
+		void
+		Denoiser::denoise(const Film& film, std::vector<RadeonRays::float3>& output) noexcept
+		{
+			std::int32_t width = film.getWidth();
+			std::int32_t height = film.getHeight();
+
+			auto size = width * height;
+			auto radiance = film.getRadiance();
+			auto sampleCount = film.getSampleCount();
+			auto moment = film.getMoment();
+			auto albedo = film.getAov(FilmAov::Albedo);
+			auto normal = film.getAov(FilmAov::Normal);
+
+			output.resize(size);
+			color_[0].resize(size);
+			color_[1].resize(size);
+			variance_[0].resize(size);
+			variance_[1].resize(size);
+			albedo_.assign(size, RadeonRays::float3(1.0f, 1.0f, 1.0f));
+			normal_.assign(size, RadeonRays::float3(0.0f, 0.0f, 0.0f));
+
+			{
+				// the worker may still be accumulating the next frame
+				std::lock_guard<const Film> guard(film);
+
+	#pragma omp parallel for
+				for (std::int32_t i = 0; i < size; ++i)
+				{
+					float n = (float)std::max<std::uint32_t>(1, sampleCount[i]);
+
+					// variance of the mean luminance, a single sample is assumed to be all noise
+					float mean = luminance(radiance[i]) / n;
+					float variance = sampleCount[i] > 1 ? std::max(0.0f, moment[i] / n - mean * mean) / (n - 1) : mean * mean;
+
+					if (albedo)
+					{
+						auto a = albedo[i] * (1.0f / n);
+						albedo_[i].x = a.x > kAlbedoEpsilon ? a.x : 1.0f;
+						albedo_[i].y = a.y > kAlbedoEpsilon ? a.y : 1.0f;
+						albedo_[i].z = a.z > kAlbedoEpsilon ? a.z : 1.0f;
+
+						float y = luminance(albedo_[i]);
+						variance /= y * y;
+					}
+
+					if (normal && normal[i].sqnorm() > 0.0f)
+						normal_[i] = RadeonRays::normalize(normal[i]);
+
+					auto& c = color_[0][i];
+					c = radiance[i] * (1.0f / n);
+					c.x /= albedo_[i].x;
+					c.y /= albedo_[i].y;
+					c.z /= albedo_[i].z;
+
+					variance_[0][i] = variance;
+				}
+			}
+
+			float albedoScale = albedoSigma_ > 0.0f ? 1.0f / (albedoSigma_ * albedoSigma_) : 0.0f;
+
+			std::uint32_t current = 0;
+
+			for (std::uint32_t iteration = 0; iteration < iterations_; iteration++, current ^= 1)
+			{
+				auto step = 1 << iteration;
+				auto src = color_[current].data();
+				auto srcVariance = variance_[current].data();
+				auto dst = color_[current ^ 1].data();
+				auto dstVariance = variance_[current ^ 1].data();
+
+	#pragma omp parallel for
+				for (std::int32_t y = 0; y < height; ++y)
+				{
+					for (std::int32_t x = 0; x < width; ++x)
+					{
+						auto p = y * width + x;
+						auto& np = normal_[p];
+						auto& ap = albedo_[p];
+						float lp = luminance(src[p]);
+
+						// the edge stop uses a 3x3 blur of the variance, single pixels are too noisy
+						float variance = 0.0f;
+						for (std::int32_t dy = -1; dy <= 1; dy++)
+						{
+							for (std::int32_t dx = -1; dx <= 1; dx++)
+							{
+								auto qx = clamp(x + dx, 0, width - 1);
+								auto qy = clamp(y + dy, 0, height - 1);
+								variance += kKernel[std::abs(dx)] * kKernel[std::abs(dy)] * srcVariance[qy * width + qx];
+							}
+						}
+
+						variance *= 1.0f / ((kKernel[0] + 2 * kKernel[1]) * (kKernel[0] + 2 * kKernel[1]));
+
+						float sigma = colorSigma_ * std::sqrt(variance) + 1e-6f;
+
+						RadeonRays::float3 sum(0.0f, 0.0f, 0.0f);
+						float sumVariance = 0.0f;
+						float sumWeight = 0.0f;
+
+						for (std::int32_t dy = -2; dy <= 2; dy++)
+						{
+							auto qy = y + dy * step;
+							if (qy < 0 || qy >= height)
+								continue;
+
+							for (std::int32_t dx = -2; dx <= 2; dx++)
+							{
+								auto qx = x + dx * step;
+								if (qx < 0 || qx >= width)
+									continue;
+
+								auto q = qy * width + qx;
+								float w = kKernel[std::abs(dx)] * kKernel[std::abs(dy)];
+
+								if (q != p)
+								{
+									w *= std::exp(-std::abs(lp - luminance(src[q])) / sigma);
+
+									// surfaces only blend with surfaces, the background with the background
+									auto& nq = normal_[q];
+									bool hasP = np.sqnorm() > 0.0f;
+									bool hasQ = nq.sqnorm() > 0.0f;
+									if (hasP != hasQ)
+										continue;
+									if (hasP)
+										w *= std::pow(std::max(0.0f, RadeonRays::dot(np, nq)), normalSigma_);
+
+									if (albedo)
+										w *= std::exp(-(ap - albedo_[q]).sqnorm() * albedoScale);
+								}
+
+								sum += src[q] * w;
+								sumVariance += srcVariance[q] * w * w;
+								sumWeight += w;
+							}
+						}
+
+						dst[p] = sum * (1.0f / sumWeight);
+						dstVariance[p] = sumVariance / (sumWeight * sumWeight);
+					}
+				}
+			}
+
+	#pragma omp parallel for
+			for (std::int32_t i = 0; i < size; ++i)
+				output[i] = color_[current][i] * albedo_[i];
+		}
+	}
+}
@@ -1,4 +1,5 @@
 #include <octoon/caustic/environment_camera.h>
+#include <octoon/caustic/math.h>
 
 namespace octoon
 {
@@ -11,5 +12,35 @@ namespace octoon
 		EnvironmentCamera::~EnvironmentCamera() noexcept
 		{
 		}
+
+		void
+		EnvironmentCamera::generateRays(const RadeonRays::int2& resolution, const RadeonRays::int2& offset, const RadeonRays::int2& size, const RadeonRays::float2* random, const RadeonRays::float2* lens, const float* times, RadeonRays::ray* rays) const noexcept
+		{
+			float phiStep = 2.0f * PI / resolution.x;
+			float thetaStep = PI / resolution.y;
+
+			auto transform = this->getTransform();
+			auto motion = this->hasMotion();
+
+	#pragma omp parallel for
+			for (std::int32_t i = 0; i < size.x * size.y; ++i)
+			{
+				auto ix = offset.x + i % size.x;
+				auto iy = offset.y + i / size.x;
+
+				float phi = (ix + random[i].x) * phiStep - PI;
+				float theta = PI - (iy + random[i].y) * thetaStep;
+
+				float sinTheta = std::sin(theta);
+				RadeonRays::float3 H(sinTheta * std::sin(phi), std::cos(theta), -sinTheta * std::cos(phi));
+
+				auto m = motion ? this->getTransform(times[i]) : transform;
+				auto o = RadeonRays::float3(m.m30, m.m31, m.m32);
+				auto d = RadeonRays::normalize(TransformVector(H, m));
+
+				rays[i] = RadeonRays::ray(o, d, std::numeric_limits<float>::max(), times[i]);
+				rays[i].SetDoBackfaceCulling(true);
+			}
+		}
 	}
-}
\ No newline at end of file
+}
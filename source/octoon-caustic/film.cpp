@@ -0,0 +1,548 @@
+#include <octoon/caustic/film.h>
+#include <octoon/caustic/math.h>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+#include <cstring>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		FilmTile::FilmTile() noexcept
+		{
+		}
+
+		FilmTile::~FilmTile() noexcept
+		{
+		}
+
+		void
+		FilmTile::reset(const RadeonRays::int2& offset, const RadeonRays::int2& size, std::uint32_t aovs) noexcept
+		{
+			offset_ = offset;
+			size_ = size;
+
+			radiance_.assign(size.x * size.y, RadeonRays::float3(0.0f, 0.0f, 0.0f));
+			sampleCount_.assign(size.x * size.y, 0);
+			moment_.assign(size.x * size.y, 0.0f);
+			color_.resize(size.x * size.y);
+
+			for (std::size_t i = 0; i < (std::size_t)FilmAov::Count; i++)
+			{
+				if (aovs & (1 << i))
+					aovs_[i].assign(size.x * size.y, RadeonRays::float3(0.0f, 0.0f, 0.0f));
+				else
+					aovs_[i].clear();
+			}
+		}
+
+		const RadeonRays::int2&
+		FilmTile::getOffset() const noexcept
+		{
+			return offset_;
+		}
+
+		const RadeonRays::int2&
+		FilmTile::getSize() const noexcept
+		{
+			return size_;
+		}
+
+		RadeonRays::float3*
+		FilmTile::getRadiance() noexcept
+		{
+			return radiance_.data();
+		}
+
+		const RadeonRays::float3*
+		FilmTile::getRadiance() const noexcept
+		{
+			return radiance_.data();
+		}
+
+		std::uint32_t*
+		FilmTile::getSampleCount() noexcept
+		{
+			return sampleCount_.data();
+		}
+
+		const std::uint32_t*
+		FilmTile::getSampleCount() const noexcept
+		{
+			return sampleCount_.data();
+		}
+
+		float*
+		FilmTile::getMoment() noexcept
+		{
+			return moment_.data();
+		}
+
+		const float*
+		FilmTile::getMoment() const noexcept
+		{
+			return moment_.data();
+		}
+
+		std::uint32_t*
+		FilmTile::getColor() noexcept
+		{
+			return color_.data();
+		}
+
+		const std::uint32_t*
+		FilmTile::getColor() const noexcept
+		{
+			return color_.data();
+		}
+
+		RadeonRays::float3*
+		FilmTile::getAov(FilmAov aov) noexcept
+		{
+			auto& buffer = aovs_[(std::size_t)aov];
+			return buffer.empty() ? nullptr : buffer.data();
+		}
+
+		const RadeonRays::float3*
+		FilmTile::getAov(FilmAov aov) const noexcept
+		{
+			auto& buffer = aovs_[(std::size_t)aov];
+			return buffer.empty() ? nullptr : buffer.data();
+		}
+
+		std::uint32_t
+		FilmTile::getAovMask() const noexcept
+		{
+			std::uint32_t mask = 0;
+			for (std::size_t i = 0; i < (std::size_t)FilmAov::Count; i++)
+			{
+				if (!aovs_[i].empty())
+					mask |= 1 << i;
+			}
+
+			return mask;
+		}
+
+		bool
+		FilmTile::save(std::ostream& stream) const noexcept
+		{
+			auto mask = this->getAovMask();
+
+			stream.write((const char*)&offset_, sizeof(offset_));
+			stream.write((const char*)&size_, sizeof(size_));
+			stream.write((const char*)&mask, sizeof(mask));
+			stream.write((const char*)radiance_.data(), radiance_.size() * sizeof(RadeonRays::float3));
+			stream.write((const char*)sampleCount_.data(), sampleCount_.size() * sizeof(std::uint32_t));
+			stream.write((const char*)moment_.data(), moment_.size() * sizeof(float));
+
+			for (auto& aov : aovs_)
+				stream.write((const char*)aov.data(), aov.size() * sizeof(RadeonRays::float3));
+
+			return stream.good();
+		}
+
+		bool
+		FilmTile::load(std::istream& stream, std::size_t maxPixels) noexcept
+		{
+			RadeonRays::int2 offset, size;
+			std::uint32_t mask = 0;
+
+			stream.read((char*)&offset, sizeof(offset));
+			stream.read((char*)&size, sizeof(size));
+			stream.read((char*)&mask, sizeof(mask));
+
+			if (!stream.good() || size.x < 0 || size.y < 0)
+				return false;
+
+			// the data may come off the network, size.x * size.y alone could overflow
+			if ((std::uint64_t)size.x * (std::uint64_t)size.y > maxPixels)
+				return false;
+
+			this->reset(offset, size, mask);
+
+			stream.read((char*)radiance_.data(), radiance_.size() * sizeof(RadeonRays::float3));
+			stream.read((char*)sampleCount_.data(), sampleCount_.size() * sizeof(std::uint32_t));
+			stream.read((char*)moment_.data(), moment_.size() * sizeof(float));
+
+			for (auto& aov : aovs_)
+				stream.read((char*)aov.data(), aov.size() * sizeof(RadeonRays::float3));
+
+			return stream.good();
+		}
+
+		std::size_t
+		FilmTile::getStreamSize(const RadeonRays::int2& size, std::uint32_t aovs) noexcept
+		{
+			std::size_t pixels = (std::size_t)std::max(size.x, 0) * (std::size_t)std::max(size.y, 0);
+			std::size_t bytes = sizeof(RadeonRays::int2) * 2 + sizeof(std::uint32_t);
+
+			bytes += pixels * (sizeof(RadeonRays::float3) + sizeof(std::uint32_t) + sizeof(float));
+
+			for (std::size_t i = 0; i < (std::size_t)FilmAov::Count; i++)
+			{
+				if (aovs & (1 << i))
+					bytes += pixels * sizeof(RadeonRays::float3);
+			}
+
+			return bytes;
+		}
+
+		Film::Film() noexcept
+			: width_(0)
+			, height_(0)
+			, aovMask_(0)
+		{
+		}
+
+		Film::Film(std::uint32_t w, std::uint32_t h) noexcept
+			: Film()
+		{
+			this->resize(w, h);
+		}
+
+		Film::~Film() noexcept
+		{
+		}
+
+		void
+		Film::resize(std::uint32_t w, std::uint32_t h, bool clear) noexcept
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+
+			width_ = w;
+			height_ = h;
+
+			// fresh allocations, so no page gets touched here
+			hdr_ = Buffer<RadeonRays::float3>(w * h);
+			sampleCount_ = Buffer<std::uint32_t>(w * h);
+			moment_ = Buffer<float>(w * h);
+			ldr_ = Buffer<std::uint32_t>(w * h);
+
+			for (std::size_t i = 0; i < (std::size_t)FilmAov::Count; i++)
+			{
+				if (aovMask_ & (1 << i))
+					aovs_[i] = Buffer<RadeonRays::float3>(w * h);
+			}
+
+			if (clear)
+				this->clear();
+		}
+
+		void
+		Film::clear() noexcept
+		{
+			std::fill(hdr_.begin(), hdr_.end(), RadeonRays::float3(0.0f, 0.0f, 0.0f));
+			std::fill(sampleCount_.begin(), sampleCount_.end(), 0);
+			std::fill(moment_.begin(), moment_.end(), 0.0f);
+			std::fill(ldr_.begin(), ldr_.end(), 0);
+
+			for (auto& aov : aovs_)
+				std::fill(aov.begin(), aov.end(), RadeonRays::float3(0.0f, 0.0f, 0.0f));
+		}
+
+		void
+		Film::clear(const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept
+		{
+			if (!this->contains(offset, size))
+				return;
+
+			for (std::int32_t y = 0; y < size.y; y++)
+			{
+				auto first = (offset.y + y) * width_ + offset.x;
+
+				std::fill_n(hdr_.data() + first, size.x, RadeonRays::float3(0.0f, 0.0f, 0.0f));
+				std::fill_n(sampleCount_.data() + first, size.x, 0);
+				std::fill_n(moment_.data() + first, size.x, 0.0f);
+				std::fill_n(ldr_.data() + first, size.x, 0);
+
+				for (auto& aov : aovs_)
+				{
+					if (!aov.empty())
+						std::fill_n(aov.data() + first, size.x, RadeonRays::float3(0.0f, 0.0f, 0.0f));
+				}
+			}
+		}
+
+		std::uint32_t
+		Film::getWidth() const noexcept
+		{
+			return width_;
+		}
+
+		std::uint32_t
+		Film::getHeight() const noexcept
+		{
+			return height_;
+		}
+
+		RadeonRays::float3*
+		Film::getRadiance() noexcept
+		{
+			return hdr_.data();
+		}
+
+		const RadeonRays::float3*
+		Film::getRadiance() const noexcept
+		{
+			return hdr_.data();
+		}
+
+		const std::uint32_t*
+		Film::getSampleCount() const noexcept
+		{
+			return sampleCount_.data();
+		}
+
+		const float*
+		Film::getMoment() const noexcept
+		{
+			return moment_.data();
+		}
+
+		float
+		Film::getVariance(std::uint32_t x, std::uint32_t y) const noexcept
+		{
+			auto index = y * width_ + x;
+			auto n = sampleCount_[index];
+			if (n < 2)
+				return 0.0f;
+
+			auto mean = luminance(hdr_[index]) / n;
+			return std::max(0.0f, (moment_[index] / n - mean * mean) * n / (n - 1));
+		}
+
+		void
+		Film::setAovEnable(FilmAov aov, bool enable) noexcept
+		{
+			auto bit = 1u << (std::uint32_t)aov;
+			if (enable == ((aovMask_ & bit) != 0))
+				return;
+
+			std::lock_guard<std::mutex> guard(mutex_);
+
+			if (enable)
+			{
+				aovMask_ |= bit;
+				aovs_[(std::size_t)aov].assign(width_ * height_, RadeonRays::float3(0.0f, 0.0f, 0.0f));
+			}
+			else
+			{
+				aovMask_ &= ~bit;
+				aovs_[(std::size_t)aov] = Buffer<RadeonRays::float3>();
+			}
+		}
+
+		bool
+		Film::getAovEnable(FilmAov aov) const noexcept
+		{
+			return (aovMask_ & (1u << (std::uint32_t)aov)) != 0;
+		}
+
+		std::uint32_t
+		Film::getAovMask() const noexcept
+		{
+			return aovMask_;
+		}
+
+		const RadeonRays::float3*
+		Film::getAov(FilmAov aov) const noexcept
+		{
+			auto& buffer = aovs_[(std::size_t)aov];
+			return buffer.empty() ? nullptr : buffer.data();
+		}
+
+		std::uint32_t*
+		Film::getColor() noexcept
+		{
+			return ldr_.data();
+		}
+
+		const std::uint32_t*
+		Film::data() const noexcept
+		{
+			return ldr_.data();
+		}
+
+		void
+		Film::accumulate(FilmTile& tile) noexcept
+		{
+			auto& offset = tile.getOffset();
+			auto& size = tile.getSize();
+
+			std::lock_guard<std::mutex> guard(mutex_);
+
+			// e.g. a film not sized yet for a camera activated while its tiles were queued
+			if (!this->contains(offset, size))
+				return;
+
+			for (std::int32_t y = 0; y < size.y; y++)
+			{
+				auto first = (offset.y + y) * width_ + offset.x;
+
+				auto src = tile.getRadiance() + y * size.x;
+				auto dst = hdr_.data() + first;
+				auto srcCount = tile.getSampleCount() + y * size.x;
+				auto dstCount = sampleCount_.data() + first;
+				auto srcMoment = tile.getMoment() + y * size.x;
+				auto dstMoment = moment_.data() + first;
+
+				for (std::int32_t x = 0; x < size.x; x++)
+				{
+					dst[x].x += src[x].x;
+					dst[x].y += src[x].y;
+					dst[x].z += src[x].z;
+					dstCount[x] += srcCount[x];
+					dstMoment[x] += srcMoment[x];
+
+					src[x] = dst[x];
+					srcCount[x] = dstCount[x];
+					srcMoment[x] = dstMoment[x];
+				}
+
+				for (std::size_t i = 0; i < (std::size_t)FilmAov::Count; i++)
+				{
+					auto srcAov = tile.getAov((FilmAov)i);
+					if (!srcAov || aovs_[i].empty())
+						continue;
+
+					srcAov += y * size.x;
+					auto dstAov = aovs_[i].data() + first;
+
+					// ids can't be averaged, the latest sample wins
+					if ((FilmAov)i == FilmAov::ShapeId || (FilmAov)i == FilmAov::MaterialId)
+						std::memcpy(dstAov, srcAov, size.x * sizeof(RadeonRays::float3));
+					else
+					{
+						for (std::int32_t x = 0; x < size.x; x++)
+							dstAov[x] += srcAov[x];
+					}
+				}
+			}
+		}
+
+		void
+		Film::resolve(const FilmTile& tile) noexcept
+		{
+			auto& offset = tile.getOffset();
+			auto& size = tile.getSize();
+
+			std::lock_guard<std::mutex> guard(mutex_);
+
+			if (!this->contains(offset, size))
+				return;
+
+			for (std::int32_t y = 0; y < size.y; y++)
+				std::memcpy(ldr_.data() + (offset.y + y) * width_ + offset.x, tile.getColor() + y * size.x, size.x * sizeof(std::uint32_t));
+		}
+	
+		void
+		Film::take(const RadeonRays::int2& offset, const RadeonRays::int2& size, FilmTile& tile) noexcept
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+
+			tile.reset(offset, size, aovMask_);
+
+			// outside the film the tile stays empty and adds nothing where it is merged
+			if (!this->contains(offset, size))
+				return;
+
+			for (std::int32_t y = 0; y < size.y; y++)
+			{
+				auto first = (offset.y + y) * width_ + offset.x;
+
+				std::memcpy(tile.getRadiance() + y * size.x, hdr_.data() + first, size.x * sizeof(RadeonRays::float3));
+				std::memcpy(tile.getSampleCount() + y * size.x, sampleCount_.data() + first, size.x * sizeof(std::uint32_t));
+				std::memcpy(tile.getMoment() + y * size.x, moment_.data() + first, size.x * sizeof(float));
+
+				std::fill_n(hdr_.data() + first, size.x, RadeonRays::float3(0.0f, 0.0f, 0.0f));
+				std::fill_n(sampleCount_.data() + first, size.x, 0);
+				std::fill_n(moment_.data() + first, size.x, 0.0f);
+
+				for (std::size_t i = 0; i < (std::size_t)FilmAov::Count; i++)
+				{
+					auto aov = tile.getAov((FilmAov)i);
+					if (!aov)
+						continue;
+
+					std::memcpy(aov + y * size.x, aovs_[i].data() + first, size.x * sizeof(RadeonRays::float3));
+					std::fill_n(aovs_[i].data() + first, size.x, RadeonRays::float3(0.0f, 0.0f, 0.0f));
+				}
+			}
+		}
+
+		bool
+		Film::contains(const RadeonRays::int2& offset, const RadeonRays::int2& size) const noexcept
+		{
+			return
+				offset.x >= 0 && offset.y >= 0 && size.x >= 0 && size.y >= 0 &&
+				(std::uint32_t)offset.x + size.x <= width_ && (std::uint32_t)offset.y + size.y <= height_;
+		}
+
+		void
+		Film::lock() const noexcept
+		{
+			mutex_.lock();
+		}
+
+		void
+		Film::unlock() const noexcept
+		{
+			mutex_.unlock();
+		}
+
+		bool
+		Film::save(std::ostream& stream) const noexcept
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+
+			stream.write((const char*)&width_, sizeof(width_));
+			stream.write((const char*)&height_, sizeof(height_));
+			stream.write((const char*)hdr_.data(), hdr_.size() * sizeof(RadeonRays::float3));
+			stream.write((const char*)sampleCount_.data(), sampleCount_.size() * sizeof(std::uint32_t));
+			stream.write((const char*)moment_.data(), moment_.size() * sizeof(float));
+			stream.write((const char*)ldr_.data(), ldr_.size() * sizeof(std::uint32_t));
+
+			stream.write((const char*)&aovMask_, sizeof(aovMask_));
+			for (auto& aov : aovs_)
+				stream.write((const char*)aov.data(), aov.size() * sizeof(RadeonRays::float3));
+
+			return stream.good();
+		}
+
+		bool
+		Film::load(std::istream& stream) noexcept
+		{
+			std::uint32_t w = 0, h = 0;
+			stream.read((char*)&w, sizeof(w));
+			stream.read((char*)&h, sizeof(h));
+
+			if (!stream.good() || w != width_ || h != height_)
+				return false;
+
+			std::lock_guard<std::mutex> guard(mutex_);
+
+			stream.read((char*)hdr_.data(), hdr_.size() * sizeof(RadeonRays::float3));
+			stream.read((char*)sampleCount_.data(), sampleCount_.size() * sizeof(std::uint32_t));
+			stream.read((char*)moment_.data(), moment_.size() * sizeof(float));
+			stream.read((char*)ldr_.data(), ldr_.size() * sizeof(std::uint32_t));
+
+			// the AOVs are restored as far as both sides have them enabled
+			std::uint32_t aovMask = 0;
+			stream.read((char*)&aovMask, sizeof(aovMask));
+
+			for (std::size_t i = 0; i < (std::size_t)FilmAov::Count; i++)
+			{
+				if (!(aovMask & (1 << i)))
+					continue;
+
+				if (aovs_[i].empty())
+					stream.ignore(width_ * height_ * sizeof(RadeonRays::float3));
+				else
+					stream.read((char*)aovs_[i].data(), aovs_[i].size() * sizeof(RadeonRays::float3));
+			}
+
+			return stream.good();
+		}
+	}
+}
\ No newline at end of file
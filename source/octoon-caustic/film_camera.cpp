@@ -1,15 +1,109 @@
 #include <octoon/caustic/film_camera.h>
+#include <octoon/caustic/math.h>
 
 namespace octoon
 {
 	namespace caustic
 	{
 		FilmCamera::FilmCamera() noexcept
+			: fov_(45.0f)
+			, aperture_(0.0f)
+			, focusDistance_(1.0f)
+			, bladeCount_(0)
 		{
 		}
 
 		FilmCamera::~FilmCamera() noexcept
 		{
 		}
+
+		void
+		FilmCamera::setFov(float fov) noexcept
+		{
+			fov_ = fov;
+		}
+
+		float
+		FilmCamera::getFov() const noexcept
+		{
+			return fov_;
+		}
+
+		void
+		FilmCamera::setAperture(float aperture) noexcept
+		{
+			aperture_ = aperture;
+		}
+
+		float
+		FilmCamera::getAperture() const noexcept
+		{
+			return aperture_;
+		}
+
+		void
+		FilmCamera::setFocusDistance(float distance) noexcept
+		{
+			focusDistance_ = distance;
+		}
+
+		float
+		FilmCamera::getFocusDistance() const noexcept
+		{
+			return focusDistance_;
+		}
+
+		void
+		FilmCamera::setBladeCount(std::uint32_t count) noexcept
+		{
+			bladeCount_ = count;
+		}
+
+		std::uint32_t
+		FilmCamera::getBladeCount() const noexcept
+		{
+			return bladeCount_;
+		}
+
+		void
+		FilmCamera::generateRays(const RadeonRays::int2& resolution, const RadeonRays::int2& offset, const RadeonRays::int2& size, const RadeonRays::float2* random, const RadeonRays::float2* lens, const float* times, RadeonRays::ray* rays) const noexcept
+		{
+			// image plane at distance one, pixels are square
+			float tanHalfFov = std::tan(fov_ * (PI / 360.0f));
+			float step = 2.0f * tanHalfFov / resolution.y;
+			float x0 = -tanHalfFov * resolution.x / resolution.y;
+			float y0 = -tanHalfFov;
+
+			auto transform = this->getTransform();
+			auto motion = this->hasMotion();
+
+	#pragma omp parallel for
+			for (std::int32_t i = 0; i < size.x * size.y; ++i)
+			{
+				auto ix = offset.x + i % size.x;
+				auto iy = offset.y + i / size.x;
+
+				float x = x0 + (ix + random[i].x) * step;
+				float y = y0 + (iy + random[i].y) * step;
+
+				RadeonRays::float3 o(0.0f, 0.0f, 0.0f);
+				RadeonRays::float3 d(x, y, -1.0f);
+
+				// rays through the lens converge where the pinhole ray meets the focus plane
+				if (aperture_ > 0.0f)
+				{
+					auto uv = bladeCount_ < 3 ? ConcentricSampleDisk(lens[i]) : UniformSamplePolygon(lens[i], bladeCount_);
+					o = RadeonRays::float3(uv.x * aperture_, uv.y * aperture_, 0.0f);
+					d = d * focusDistance_ - o;
+				}
+
+				auto m = motion ? this->getTransform(times[i]) : transform;
+				o = TransformPoint(o, m);
+				d = RadeonRays::normalize(TransformVector(d, m));
+
+				rays[i] = RadeonRays::ray(o, d, std::numeric_limits<float>::max(), times[i]);
+				rays[i].SetDoBackfaceCulling(true);
+			}
+		}
 	}
-}
\ No newline at end of file
+}
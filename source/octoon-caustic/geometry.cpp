@@ -1,5 +1,7 @@
 #include <octoon/caustic/geometry.h>
+#include <octoon/caustic/geometry_instance.h>
 #include <octoon/caustic/render_scene.h>
+#include <algorithm>
 
 namespace octoon
 {
@@ -7,17 +9,30 @@ namespace octoon
 	{
 		Geometry::Geometry() noexcept
 			: mesh_(nullptr)
+			, shapeId_(RenderScene::instance().allocShapeId())
 		{
 		}
 
 		Geometry::~Geometry() noexcept
 		{
+			auto& scene = RenderScene::instance();
+
+			if (data_)
+			{
+				if (this->getActive())
+					scene.detachShape(mesh_);
+				scene.deleteShape(mesh_);
+				scene.commit();
+			}
+
+			scene.freeShapeId(shapeId_);
 		}
 
 		void 
 		Geometry::setMaterial(std::shared_ptr<Material>& material) noexcept
 		{
 			material_ = material;
+			RenderScene::instance().touch();
 		}
 
 		const std::shared_ptr<Material>&
@@ -29,13 +44,208 @@ namespace octoon
 		void
 		Geometry::setShape(const float* vertices, int vnum, int vstride, const int* indices, int istride, const int* numfacevertices, int numfaces) noexcept
 		{
-			auto api = RenderScene::instance().getIntersectionApi();
-			if (mesh_)
-				api->DeleteShape(mesh_);
+			auto mesh = std::make_shared<Mesh>();
+			mesh->positions.resize(vnum * 3);
+			mesh->normals.resize(vnum * 3);
+
+			auto vbytes = vstride ? vstride : 3 * sizeof(float);
+			for (int i = 0; i < vnum; i++)
+			{
+				auto v = (const float*)((const char*)vertices + vbytes * i);
+				mesh->positions[i * 3] = v[0];
+				mesh->positions[i * 3 + 1] = v[1];
+				mesh->positions[i * 3 + 2] = v[2];
+			}
+
+			auto ibytes = istride ? istride : sizeof(int);
+			auto index = [&](int i) { return *(const int*)((const char*)indices + ibytes * i); };
+
+			for (int face = 0, first = 0; face < numfaces; face++)
+			{
+				auto count = numfacevertices ? numfacevertices[face] : 3;
+
+				for (int k = 2; k < count; k++)
+				{
+					mesh->indices.push_back(index(first));
+					mesh->indices.push_back(index(first + k - 1));
+					mesh->indices.push_back(index(first + k));
+				}
+
+				first += count;
+			}
+
+			auto& p = mesh->positions;
+			auto& n = mesh->normals;
+
+			for (std::size_t i = 0; i < mesh->indices.size(); i += 3)
+			{
+				auto i0 = mesh->indices[i] * 3;
+				auto i1 = mesh->indices[i + 1] * 3;
+				auto i2 = mesh->indices[i + 2] * 3;
+
+				RadeonRays::float3 a(p[i0], p[i0 + 1], p[i0 + 2]);
+				RadeonRays::float3 b(p[i1], p[i1 + 1], p[i1 + 2]);
+				RadeonRays::float3 c(p[i2], p[i2 + 1], p[i2 + 2]);
+
+				auto N = RadeonRays::cross(b - a, c - a);
+
+				for (auto it : { i0, i1, i2 })
+				{
+					n[it] += N.x;
+					n[it + 1] += N.y;
+					n[it + 2] += N.z;
+				}
+			}
+
+			for (std::size_t i = 0; i < n.size(); i += 3)
+			{
+				auto N = RadeonRays::normalize(RadeonRays::float3(n[i], n[i + 1], n[i + 2]));
+				n[i] = N.x;
+				n[i + 1] = N.y;
+				n[i + 2] = N.z;
+			}
+
+			mesh->compress();
+
+			this->setMesh(mesh);
+		}
+
+		void
+		Geometry::setMesh(const std::shared_ptr<Mesh>& mesh) noexcept
+		{
+			auto& scene = RenderScene::instance();
+			scene.beginUpdate();
+
+			std::vector<GeometryInstance*> instances;
+			{
+				std::lock_guard<std::mutex> guard(instancesLock_);
+				instances = instances_;
+			}
+
+			if (data_)
+			{
+				if (this->getActive())
+					scene.detachShape(mesh_);
+
+				for (auto& it : instances)
+					it->destroyShape();
+
+				scene.deleteShape(mesh_);
+				mesh_ = nullptr;
+			}
+
+			data_ = mesh;
+
+			if (data_)
+			{
+				std::vector<float> positions;
+				if (!data_->packedPositions.empty())
+					data_->getPositions(positions);
+
+				auto vertices = positions.empty() ? data_->positions.data() : positions.data();
 
-			mesh_ = api->CreateMesh(vertices, vnum, vstride, indices, istride, numfacevertices, numfaces);
+				mesh_ = scene.createMesh(vertices, (int)data_->getNumVertices(), 3 * sizeof(float), data_->indices.data(), 0, nullptr, (int)data_->getNumTriangles(), shapeId_);
+
+				this->onMoveAfter();
+
+				if (this->getActive())
+					scene.attachShape(mesh_);
+			}
+
+			for (auto& it : instances)
+				it->onShapeChange();
+
+			scene.endUpdate();
+		}
+
+		const std::shared_ptr<Mesh>&
+		Geometry::getMesh() const noexcept
+		{
+			return data_;
+		}
 
-			api->Commit();
+		void
+		Geometry::updateMesh() noexcept
+		{
+			if (data_)
+			{
+				auto mesh = data_;
+				mesh->revision++;
+
+				// RadeonRays has no refit, its shape is recreated from the new vertices
+				this->setMesh(mesh);
+			}
+		}
+
+		std::int32_t
+		Geometry::getShapeId() const noexcept
+		{
+			return data_ ? shapeId_ : RadeonRays::kNullId;
+		}
+
+		RadeonRays::Shape*
+		Geometry::getShape() const noexcept
+		{
+			return mesh_;
+		}
+
+		void
+		Geometry::addInstance(GeometryInstance* instance) noexcept
+		{
+			assert(instance);
+
+			std::lock_guard<std::mutex> guard(instancesLock_);
+			auto it = std::find(instances_.begin(), instances_.end(), instance);
+			if (it == instances_.end())
+				instances_.push_back(instance);
+		}
+
+		void
+		Geometry::removeInstance(GeometryInstance* instance) noexcept
+		{
+			assert(instance);
+
+			std::lock_guard<std::mutex> guard(instancesLock_);
+			auto it = std::find(instances_.begin(), instances_.end(), instance);
+			if (it != instances_.end())
+				instances_.erase(it);
+		}
+
+		void
+		Geometry::onActivate() noexcept
+		{
+			RenderObject::onActivate();
+
+			if (data_)
+			{
+				auto& scene = RenderScene::instance();
+				scene.attachShape(mesh_);
+				scene.commit();
+			}
+		}
+
+		void
+		Geometry::onDeactivate() noexcept
+		{
+			if (data_)
+			{
+				auto& scene = RenderScene::instance();
+				scene.detachShape(mesh_);
+				scene.commit();
+			}
+
+			RenderObject::onDeactivate();
+		}
+
+		void
+		Geometry::onMoveAfter() noexcept
+		{
+			if (data_)
+			{
+				auto& scene = RenderScene::instance();
+				scene.setShapeTransform(mesh_, this->getTransform(), this->getTransformInverse());
+				scene.commit();
+			}
 		}
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,159 @@
+#include <octoon/caustic/geometry_instance.h>
+#include <octoon/caustic/render_scene.h>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		GeometryInstance::GeometryInstance() noexcept
+			: instance_(nullptr)
+			, shapeId_(RenderScene::instance().allocShapeId())
+		{
+		}
+
+		GeometryInstance::GeometryInstance(const std::shared_ptr<Geometry>& geometry) noexcept
+			: GeometryInstance()
+		{
+			this->setGeometry(geometry);
+		}
+
+		GeometryInstance::~GeometryInstance() noexcept
+		{
+			this->destroyShape();
+
+			if (geometry_)
+				geometry_->removeInstance(this);
+
+			auto& scene = RenderScene::instance();
+			scene.commit();
+			scene.freeShapeId(shapeId_);
+		}
+
+		void
+		GeometryInstance::setGeometry(const std::shared_ptr<Geometry>& geometry) noexcept
+		{
+			if (geometry_ != geometry)
+			{
+				auto& scene = RenderScene::instance();
+				scene.beginUpdate();
+
+				this->destroyShape();
+
+				if (geometry_)
+					geometry_->removeInstance(this);
+
+				geometry_ = geometry;
+
+				if (geometry_)
+				{
+					geometry_->addInstance(this);
+					this->onShapeChange();
+				}
+
+				scene.endUpdate();
+			}
+		}
+
+		const std::shared_ptr<Geometry>&
+		GeometryInstance::getGeometry() const noexcept
+		{
+			return geometry_;
+		}
+
+		void
+		GeometryInstance::setMaterial(const std::shared_ptr<Material>& material) noexcept
+		{
+			material_ = material;
+			RenderScene::instance().touch();
+		}
+
+		const std::shared_ptr<Material>&
+		GeometryInstance::getMaterial() const noexcept
+		{
+			if (!material_ && geometry_)
+				return geometry_->getMaterial();
+			return material_;
+		}
+
+		std::int32_t
+		GeometryInstance::getShapeId() const noexcept
+		{
+			return geometry_ && geometry_->getMesh() ? shapeId_ : RadeonRays::kNullId;
+		}
+
+		void
+		GeometryInstance::onShapeChange() noexcept
+		{
+			this->destroyShape();
+			this->createShape();
+
+			if (this->getShapeId() != RadeonRays::kNullId && this->getActive())
+				RenderScene::instance().attachShape(instance_);
+		}
+
+		void
+		GeometryInstance::createShape() noexcept
+		{
+			assert(!instance_);
+
+			if (this->getShapeId() != RadeonRays::kNullId)
+			{
+				if (geometry_->getShape())
+					instance_ = RenderScene::instance().createInstance(geometry_->getShape(), shapeId_);
+
+				this->onMoveAfter();
+			}
+		}
+
+		void
+		GeometryInstance::destroyShape() noexcept
+		{
+			if (this->getShapeId() != RadeonRays::kNullId)
+			{
+				auto& scene = RenderScene::instance();
+				if (this->getActive())
+					scene.detachShape(instance_);
+
+				scene.deleteShape(instance_);
+				instance_ = nullptr;
+			}
+		}
+
+		void
+		GeometryInstance::onActivate() noexcept
+		{
+			RenderObject::onActivate();
+
+			if (this->getShapeId() != RadeonRays::kNullId)
+			{
+				auto& scene = RenderScene::instance();
+				scene.attachShape(instance_);
+				scene.commit();
+			}
+		}
+
+		void
+		GeometryInstance::onDeactivate() noexcept
+		{
+			if (this->getShapeId() != RadeonRays::kNullId)
+			{
+				auto& scene = RenderScene::instance();
+				scene.detachShape(instance_);
+				scene.commit();
+			}
+
+			RenderObject::onDeactivate();
+		}
+
+		void
+		GeometryInstance::onMoveAfter() noexcept
+		{
+			if (this->getShapeId() != RadeonRays::kNullId)
+			{
+				auto& scene = RenderScene::instance();
+				scene.setShapeTransform(instance_, this->getTransform(), this->getTransformInverse());
+				scene.commit();
+			}
+		}
+	}
+}
@@ -0,0 +1,326 @@
+#include <octoon/caustic/image_writer.h>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <initializer_list>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		// both formats are little endian and the writers store values in host order
+#if defined(__BYTE_ORDER__)
+		constexpr bool kLittleEndian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#else
+		constexpr bool kLittleEndian = true;
+#endif
+		static_assert(kLittleEndian, "the EXR and PFM writers need a little endian host");
+
+		std::uint16_t FloatToHalf(float f) noexcept
+		{
+			std::uint32_t x;
+			std::memcpy(&x, &f, sizeof(x));
+
+			std::uint32_t sign = (x >> 16) & 0x8000;
+			std::uint32_t bits = x & 0x7FFFFFFF;
+
+			// inf and nan, nan keeps a mantissa bit
+			if (bits >= 0x7F800000)
+				return (std::uint16_t)(sign | 0x7C00 | (bits > 0x7F800000 ? 0x200 : 0));
+
+			// 65520 and above round to inf
+			if (bits >= 0x477FF000)
+				return (std::uint16_t)(sign | 0x7C00);
+
+			// subnormal halfs, rounded to nearest even
+			if (bits < 0x38800000)
+			{
+				if (bits < 0x33000000)
+					return (std::uint16_t)sign;
+
+				std::uint32_t mantissa = (bits & 0x7FFFFF) | 0x800000;
+				std::uint32_t shift = 126 - (bits >> 23);
+				return (std::uint16_t)(sign | ((mantissa + (1u << (shift - 1)) - 1 + ((mantissa >> shift) & 1)) >> shift));
+			}
+
+			bits += 0xFFF + ((bits >> 13) & 1);
+			return (std::uint16_t)(sign | ((bits - 0x38000000) >> 13));
+		}
+
+		// OpenEXR run length scheme, the literal and run blocks of the reference RleCompressor.
+		std::size_t CompressRLE(const std::uint8_t* in, std::size_t size, std::int8_t* out) noexcept
+		{
+			constexpr std::ptrdiff_t kMinRunLength = 3;
+			constexpr std::ptrdiff_t kMaxRunLength = 127;
+
+			auto end = in + size;
+			auto runStart = in;
+			auto runEnd = in + 1;
+			auto write = out;
+
+			while (runStart < end)
+			{
+				while (runEnd < end && *runStart == *runEnd && runEnd - runStart - 1 < kMaxRunLength)
+					++runEnd;
+
+				if (runEnd - runStart >= kMinRunLength)
+				{
+					*write++ = (std::int8_t)((runEnd - runStart) - 1);
+					*write++ = (std::int8_t)*runStart;
+					runStart = runEnd;
+				}
+				else
+				{
+					while (runEnd < end &&
+						((runEnd + 1 >= end || *runEnd != *(runEnd + 1)) || (runEnd + 2 >= end || *(runEnd + 1) != *(runEnd + 2))) &&
+						runEnd - runStart < kMaxRunLength)
+					{
+						++runEnd;
+					}
+
+					*write++ = (std::int8_t)(runStart - runEnd);
+					while (runStart < runEnd)
+						*write++ = (std::int8_t)*runStart++;
+				}
+
+				++runEnd;
+			}
+
+			return write - out;
+		}
+
+		template<typename T>
+		void WriteValue(std::ostream& stream, const T& value) noexcept
+		{
+			stream.write((const char*)&value, sizeof(T));
+		}
+
+		void WriteAttribute(std::ostream& stream, const char* name, const char* type, std::int32_t size, const void* value) noexcept
+		{
+			stream.write(name, std::strlen(name) + 1);
+			stream.write(type, std::strlen(type) + 1);
+			WriteValue(stream, size);
+			stream.write((const char*)value, size);
+		}
+
+		bool WriteEXR(std::ostream& stream, std::uint32_t width, std::uint32_t height, const std::vector<ImageChannel>& channels, ExrPixelType type, ExrCompression compression) noexcept
+		{
+			if (!stream || width == 0 || height == 0 || channels.empty())
+				return false;
+
+			// channels are stored in alphabetical order
+			std::vector<ImageChannel> sorted(channels);
+			std::sort(sorted.begin(), sorted.end(), [](const ImageChannel& a, const ImageChannel& b) { return a.name < b.name; });
+
+			auto base = stream.tellp();
+
+			WriteValue(stream, std::uint32_t(20000630));
+			WriteValue(stream, std::uint32_t(2));
+
+			std::string chlist;
+			for (auto& channel : sorted)
+			{
+				std::int32_t pixelType = type == ExrPixelType::Half ? 1 : 2;
+				std::int32_t sampling[2] = { 1, 1 };
+				std::uint8_t linear[4] = { 0, 0, 0, 0 };
+
+				chlist.append(channel.name.c_str(), channel.name.size() + 1);
+				chlist.append((const char*)&pixelType, sizeof(pixelType));
+				chlist.append((const char*)linear, sizeof(linear));
+				chlist.append((const char*)sampling, sizeof(sampling));
+			}
+			chlist.push_back(0);
+
+			std::uint8_t compressionType = compression == ExrCompression::RLE ? 1 : 0;
+			std::uint8_t lineOrder = 0;
+			std::int32_t window[4] = { 0, 0, (std::int32_t)width - 1, (std::int32_t)height - 1 };
+			float pixelAspectRatio = 1.0f;
+			float screenWindowCenter[2] = { 0.0f, 0.0f };
+			float screenWindowWidth = 1.0f;
+
+			WriteAttribute(stream, "channels", "chlist", (std::int32_t)chlist.size(), chlist.data());
+			WriteAttribute(stream, "compression", "compression", sizeof(compressionType), &compressionType);
+			WriteAttribute(stream, "dataWindow", "box2i", sizeof(window), window);
+			WriteAttribute(stream, "displayWindow", "box2i", sizeof(window), window);
+			WriteAttribute(stream, "lineOrder", "lineOrder", sizeof(lineOrder), &lineOrder);
+			WriteAttribute(stream, "pixelAspectRatio", "float", sizeof(pixelAspectRatio), &pixelAspectRatio);
+			WriteAttribute(stream, "screenWindowCenter", "v2f", sizeof(screenWindowCenter), screenWindowCenter);
+			WriteAttribute(stream, "screenWindowWidth", "float", sizeof(screenWindowWidth), &screenWindowWidth);
+			stream.put(0);
+
+			// one chunk per scanline, the offset table is filled in once the chunk sizes are known
+			auto table = stream.tellp();
+			std::vector<std::uint64_t> offsets(height);
+			stream.write((const char*)offsets.data(), offsets.size() * sizeof(std::uint64_t));
+
+			std::size_t bytesPerValue = type == ExrPixelType::Half ? 2 : 4;
+			std::size_t lineSize = width * sorted.size() * bytesPerValue;
+
+			std::vector<std::uint8_t> line(lineSize);
+			std::vector<std::uint8_t> reordered(lineSize);
+			std::vector<std::int8_t> packed(lineSize * 3 / 2 + 2);
+
+			for (std::uint32_t y = 0; y < height; y++)
+			{
+				// exr rows go top down, the film bottom up
+				auto row = (height - 1 - y) * width;
+				auto dst = line.data();
+
+				for (auto& channel : sorted)
+				{
+					for (std::uint32_t x = 0; x < width; x++)
+					{
+						auto index = row + x;
+						auto value = channel.data[index * channel.stride];
+						if (channel.sampleCount)
+							value /= std::max<std::uint32_t>(1, channel.sampleCount[index]);
+
+						if (type == ExrPixelType::Half)
+						{
+							auto half = FloatToHalf(value);
+							std::memcpy(dst, &half, sizeof(half));
+						}
+						else
+						{
+							std::memcpy(dst, &value, sizeof(value));
+						}
+
+						dst += bytesPerValue;
+					}
+				}
+
+				const char* data = (const char*)line.data();
+				std::int32_t dataSize = (std::int32_t)lineSize;
+
+				if (compression == ExrCompression::RLE)
+				{
+					// split even and odd bytes, then delta encode, as the exr zip and rle codecs do
+					auto t1 = reordered.data();
+					auto t2 = reordered.data() + (lineSize + 1) / 2;
+
+					for (std::size_t i = 0; i < lineSize;)
+					{
+						*t1++ = line[i++];
+						if (i < lineSize)
+							*t2++ = line[i++];
+					}
+
+					std::int32_t p = reordered[0];
+					for (std::size_t i = 1; i < lineSize; i++)
+					{
+						std::int32_t d = std::int32_t(reordered[i]) - p + (128 + 256);
+						p = reordered[i];
+						reordered[i] = (std::uint8_t)d;
+					}
+
+					auto size = CompressRLE(reordered.data(), lineSize, packed.data());
+					if (size < lineSize)
+					{
+						data = (const char*)packed.data();
+						dataSize = (std::int32_t)size;
+					}
+				}
+
+				offsets[y] = (std::uint64_t)(stream.tellp() - base);
+
+				WriteValue(stream, (std::int32_t)y);
+				WriteValue(stream, dataSize);
+				stream.write(data, dataSize);
+			}
+
+			auto end = stream.tellp();
+			stream.seekp(table);
+			stream.write((const char*)offsets.data(), offsets.size() * sizeof(std::uint64_t));
+			stream.seekp(end);
+
+			return stream.good();
+		}
+
+		bool WriteEXR(std::ostream& stream, const Film& film, ExrPixelType type, ExrCompression compression) noexcept
+		{
+			auto radiance = (const float*)film.getRadiance();
+			auto stride = (std::uint32_t)(sizeof(RadeonRays::float3) / sizeof(float));
+
+			std::vector<ImageChannel> channels;
+			channels.push_back(ImageChannel{ "R", radiance, stride, film.getSampleCount() });
+			channels.push_back(ImageChannel{ "G", radiance + 1, stride, film.getSampleCount() });
+			channels.push_back(ImageChannel{ "B", radiance + 2, stride, film.getSampleCount() });
+
+			// enabled AOVs go into layers next to the beauty, sums are averaged like the radiance
+			auto addAov = [&](FilmAov aov, std::initializer_list<const char*> names, bool average)
+			{
+				auto data = (const float*)film.getAov(aov);
+				if (!data)
+					return;
+
+				for (auto name : names)
+					channels.push_back(ImageChannel{ name, data++, stride, average ? film.getSampleCount() : nullptr });
+			};
+
+			addAov(FilmAov::Depth, { "Z" }, true);
+			addAov(FilmAov::Normal, { "N.X", "N.Y", "N.Z" }, true);
+			addAov(FilmAov::Albedo, { "albedo.R", "albedo.G", "albedo.B" }, true);
+			addAov(FilmAov::ShapeId, { "shapeId" }, false);
+			addAov(FilmAov::MaterialId, { "materialId" }, false);
+			addAov(FilmAov::Direct, { "direct.R", "direct.G", "direct.B" }, true);
+			addAov(FilmAov::Indirect, { "indirect.R", "indirect.G", "indirect.B" }, true);
+			addAov(FilmAov::SampleCount, { "sampleCount" }, false);
+
+			return WriteEXR(stream, film.getWidth(), film.getHeight(), channels, type, compression);
+		}
+
+		bool WritePFM(std::ostream& stream, const Film& film) noexcept
+		{
+			auto width = film.getWidth();
+			auto height = film.getHeight();
+
+			if (!stream || width == 0 || height == 0)
+				return false;
+
+			// a negative scale marks little endian data, rows go bottom up like the film
+			std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+			stream.write(header.data(), header.size());
+
+			std::vector<float> line(width * 3);
+
+			for (std::uint32_t y = 0; y < height; y++)
+			{
+				auto radiance = film.getRadiance() + y * width;
+				auto sampleCount = film.getSampleCount() + y * width;
+
+				for (std::uint32_t x = 0; x < width; x++)
+				{
+					float scale = 1.0f / std::max<std::uint32_t>(1, sampleCount[x]);
+					line[x * 3] = radiance[x].x * scale;
+					line[x * 3 + 1] = radiance[x].y * scale;
+					line[x * 3 + 2] = radiance[x].z * scale;
+				}
+
+				stream.write((const char*)line.data(), line.size() * sizeof(float));
+			}
+
+			return stream.good();
+		}
+
+		void WriteEXR(const std::string& filepath, const Film& film, ExrPixelType type, ExrCompression compression) noexcept(false)
+		{
+			std::ofstream stream(filepath, std::ios_base::out | std::ios_base::binary);
+			if (!stream)
+				throw std::runtime_error("failed to open the file: " + filepath);
+
+			if (!WriteEXR(stream, film, type, compression))
+				throw std::runtime_error("failed to write the file: " + filepath);
+		}
+
+		void WritePFM(const std::string& filepath, const Film& film) noexcept(false)
+		{
+			std::ofstream stream(filepath, std::ios_base::out | std::ios_base::binary);
+			if (!stream)
+				throw std::runtime_error("failed to open the file: " + filepath);
+
+			if (!WritePFM(stream, film))
+				throw std::runtime_error("failed to write the file: " + filepath);
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#include "intersector.h"
+
+namespace octoon
+{
+	namespace caustic
+	{
+		Intersector::Intersector() noexcept
+		{
+		}
+
+		Intersector::~Intersector() noexcept
+		{
+		}
+
+		bool
+		Intersector::hasMotionBlur() const noexcept
+		{
+			return false;
+		}
+
+		bool
+		Intersector::getStats(TraversalStats& stats) const noexcept
+		{
+			return false;
+		}
+	}
+}
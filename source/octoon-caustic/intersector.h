@@ -0,0 +1,60 @@
+#ifndef OCTOON_CAUSTIC_INTERSECTOR_H_
+#define OCTOON_CAUSTIC_INTERSECTOR_H_
+
+#include <vector>
+#include <memory>
+#include <radeon_rays.h>
+
+#include <octoon/caustic/material.h>
+#include <octoon/caustic/mesh.h>
+#include <octoon/caustic/pipeline.h>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		struct ShapeData
+		{
+			std::shared_ptr<const Mesh> mesh;
+			const Material* material;
+			// index of the material in order of first use, for the material id AOV
+			std::int32_t materialId;
+
+			RadeonRays::matrix transform;
+			RadeonRays::matrix transformInverse;
+
+			// end of the shutter interval, only read when motion is set
+			RadeonRays::matrix motionTransform;
+			RadeonRays::matrix motionTransformInverse;
+			bool motion;
+		};
+
+		// Traces host memory ray streams, results follow RadeonRays::Intersection.
+		class Intersector
+		{
+		public:
+			Intersector() noexcept;
+			virtual ~Intersector() noexcept;
+
+			// Called once per estimate with the shapes indexed by id, revision changes whenever the scene was committed.
+			virtual void commit(const std::vector<ShapeData>& shapes, std::uint32_t revision) noexcept = 0;
+
+			// Closest hit per ray.
+			virtual void intersect(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) noexcept = 0;
+			// Only shapeid is meaningful, kNullId when nothing blocks the ray.
+			virtual void occlude(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) noexcept = 0;
+
+			// Whether shapes are placed at the ray time, otherwise every ray sees them at their start transform.
+			virtual bool hasMotionBlur() const noexcept;
+
+			// Stats of the structure built by the last commit, false when the backend has none to report.
+			virtual bool getStats(TraversalStats& stats) const noexcept;
+
+		private:
+			Intersector(const Intersector&) = delete;
+			Intersector& operator=(const Intersector&) = delete;
+		};
+	}
+}
+
+#endif
@@ -3,10 +3,13 @@
 #include <iostream>
 #include <ctime>
 #include <random>
+#include <cstring>
+#include <cstdlib>
 #include <GLFW/glfw3.h>
 #include <GL/GL.h>
 
 #include <octoon/caustic/system.h>
+#include <octoon/caustic/image_writer.h>
 
 void dumpTGA(std::ostream& stream, std::uint8_t pixesl[], std::uint32_t width, std::uint32_t height, std::uint8_t channel) noexcept
 {
@@ -39,11 +42,7 @@ void dumpTGA(std::ostream& stream, std::uint8_t pixesl[], std::uint32_t width, s
 	stream.write((char*)&pixel_size, sizeof(pixel_size));
 	stream.write((char*)&attributes, sizeof(attributes));
 
-	std::vector<std::uint8_t> buffer(width * height * channel);
-	for (std::size_t i = 0; i < buffer.size(); i++)
-		buffer[i] = pixesl[i];
-
-	stream.write((char*)buffer.data(), width * height * channel);
+	stream.write((char*)pixesl, width * height * channel);
 }
 
 void dumpTGA(const char* filepath, std::uint8_t pixesl[], std::uint32_t width, std::uint32_t height, std::uint8_t channel) noexcept(false)
@@ -60,6 +59,18 @@ int main(int argc, const char* argv[])
 	auto width = 1376;
 	auto height = 768;
 
+	// render node: --worker <host> <port>, renders the tiles the coordinator hands out until it quits
+	if (argc >= 4 && std::strcmp(argv[1], "--worker") == 0)
+	{
+		// render nodes trace on the host, they need neither an OpenCL device nor a window
+		octoon::caustic::System engine;
+		engine.setWorkerGroups(0);
+		engine.setThreadPinning(true);
+		engine.setup(width, height, octoon::caustic::TraversalBackend::Native);
+
+		return engine.work(argv[2], (std::uint16_t)std::atoi(argv[3])) ? 0 : 1;
+	}
+
 	if (::glfwInit() == GL_FALSE)
 		return 0;
 
@@ -80,13 +91,57 @@ int main(int argc, const char* argv[])
 
 		glEnable(GL_TEXTURE_2D);
 
-		octoon::caustic::System engine(width, height);
+		// one pinned worker group per NUMA node, set before setup so each node first touches its film rows
+		// and workspace, pinning keeps those pages and the threads touching them on the same node
+		octoon::caustic::System engine;
+		engine.setWorkerGroups(0);
+		engine.setThreadPinning(true);
+		engine.setup(width, height);
+
+		// resume an interrupted job, the checkpoint is refreshed every 50 frames
+		const char* checkpoint = "C:/Users/Public/Pictures/test.checkpoint";
+		std::uint32_t first_frame = engine.loadCheckpoint(checkpoint) + 1;
+		engine.setCheckpoint(checkpoint, 50);
+		engine.setDenoise(true);
+		engine.setFramesInFlight(2);
+		engine.setTileSizeAuto();
+		engine.setTileOrder(octoon::caustic::TileOrder::Spiral);
+
+		// coordinator: --listen <port>, render nodes may join at any time
+		if (argc >= 3 && std::strcmp(argv[1], "--listen") == 0)
+			engine.listen((std::uint16_t)std::atoi(argv[2]));
 
 		std::time_t begin_time = std::clock();
 
 		std::uint32_t frame_num = 1000;
 
-		for (std::uint32_t frame = 1; frame < frame_num; frame++)
+		std::vector<octoon::caustic::PreviewRect> rects;
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+
+		// only the finished tiles are uploaded, at most once per refresh unless flushed
+		auto present = [&](bool flush)
+		{
+			if (!engine.resolvePreview(rects, flush))
+				return;
+
+			for (auto& rect : rects)
+				glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.w, rect.h, GL_RGBA, GL_UNSIGNED_BYTE, engine.data() + rect.y * width + rect.x);
+
+			int w = 0, h = 0;
+			glfwGetWindowSize(window, &w, & h);
+			glViewport(0, 0, w, h);
+
+			glBegin(GL_QUADS);
+			glTexCoord2f(0.0f, 0.0f); glVertex3f(-1.0f, -1.0f, 0.0f);
+			glTexCoord2f(1.0f, 0.0f); glVertex3f(1.0f, -1.0f, 0.0f);
+			glTexCoord2f(1.0f, 1.0f); glVertex3f(1.0f, 1.0f, 0.0f);
+			glTexCoord2f(0.0f, 1.0f); glVertex3f(-1.0f, 1.0f, 0.0f);
+			glEnd();
+
+			glfwSwapBuffers(window);
+		};
+
+		for (std::uint32_t frame = first_frame; frame < frame_num; frame++)
 		{
 			engine.render(frame);
 
@@ -95,26 +150,16 @@ int main(int argc, const char* argv[])
 				if (::glfwWindowShouldClose(window))
 					goto exit;
 
-				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, engine.data());
-
-				int w = 0, h = 0;
-				glfwGetWindowSize(window, &w, & h);
-				glViewport(0, 0, w, h);
-
-				glBegin(GL_QUADS);
-				glTexCoord2f(0.0f, 0.0f); glVertex3f(-1.0f, -1.0f, 0.0f);
-				glTexCoord2f(1.0f, 0.0f); glVertex3f(1.0f, -1.0f, 0.0f);
-				glTexCoord2f(1.0f, 1.0f); glVertex3f(1.0f, 1.0f, 0.0f);
-				glTexCoord2f(0.0f, 1.0f); glVertex3f(-1.0f, 1.0f, 0.0f);
-				glEnd();
-
 				glfwPollEvents();
-				glfwSwapBuffers(window);
+				present(false);
 			}
 
+			// the tiles that completed the frame, without waiting for the next one
+			present(true);
+
 			std::time_t cur_time = std::clock();
 			float elapsed_time = (cur_time - begin_time) / 1000.f;
-			float average_time_per_pass = elapsed_time / frame;
+			float average_time_per_pass = elapsed_time / (frame - first_frame + 1);
 			float time_remaining = (frame_num - frame) * average_time_per_pass;
 
 			std::system("cls");
@@ -124,8 +169,21 @@ int main(int argc, const char* argv[])
 			std::cerr << "time remaining: " << time_remaining << std::endl;
 		}
 
+		engine.wait_all();
+
+		// the last frames may not have reached the denoise interval
+		if (engine.getDenoise())
+			engine.denoise();
+
+		present(true);
+
 		system("pause");
 		dumpTGA("C:/Users/Public/Pictures/test.tga", (std::uint8_t*)engine.data(), width, height, 4);
+
+		// linear radiance for compositing
+		auto& cameras = octoon::caustic::RenderScene::instance().getCameraList();
+		if (!cameras.empty())
+			octoon::caustic::WriteEXR("C:/Users/Public/Pictures/test.exr", *cameras.front()->getFilm());
 	}
 
 exit:
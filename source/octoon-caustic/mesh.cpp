@@ -0,0 +1,164 @@
+#include <octoon/caustic/mesh.h>
+#include <octoon/caustic/math.h>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		template<typename T>
+		void ReleaseStream(std::vector<T>& stream) noexcept
+		{
+			std::vector<T>().swap(stream);
+		}
+
+		std::uint16_t QuantizeUnorm16(float x) noexcept
+		{
+			return (std::uint16_t)std::round(saturate(x) * 65535.0f);
+		}
+
+		std::uint32_t
+		Mesh::encodeNormal(const RadeonRays::float3& n) noexcept
+		{
+			float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+			float x = l1 > 0.0f ? n.x / l1 : 0.0f;
+			float y = l1 > 0.0f ? n.y / l1 : 0.0f;
+
+			if (n.z < 0.0f)
+			{
+				float ox = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+				float oy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+				x = ox;
+				y = oy;
+			}
+
+			return QuantizeUnorm16(x * 0.5f + 0.5f) | QuantizeUnorm16(y * 0.5f + 0.5f) << 16;
+		}
+
+		void
+		Mesh::compress(bool quantizePositions) noexcept
+		{
+			if (!normals.empty())
+			{
+				packedNormals.resize(normals.size() / 3);
+
+				for (std::size_t i = 0; i < packedNormals.size(); i++)
+					packedNormals[i] = encodeNormal(RadeonRays::float3(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]));
+
+				ReleaseStream(normals);
+			}
+
+			if (!texcoords.empty())
+			{
+				RadeonRays::float2 minUV(texcoords[0], texcoords[1]);
+				RadeonRays::float2 maxUV(texcoords[0], texcoords[1]);
+
+				for (std::size_t i = 0; i < texcoords.size(); i += 2)
+				{
+					minUV.x = std::min(minUV.x, texcoords[i]);
+					minUV.y = std::min(minUV.y, texcoords[i + 1]);
+					maxUV.x = std::max(maxUV.x, texcoords[i]);
+					maxUV.y = std::max(maxUV.y, texcoords[i + 1]);
+				}
+
+				texcoordMin = minUV;
+				texcoordScale = RadeonRays::float2((maxUV.x - minUV.x) / 65535.0f, (maxUV.y - minUV.y) / 65535.0f);
+
+				packedTexcoords.resize(texcoords.size());
+
+				for (std::size_t i = 0; i < texcoords.size(); i += 2)
+				{
+					packedTexcoords[i] = texcoordScale.x > 0.0f ? QuantizeUnorm16((texcoords[i] - minUV.x) / (maxUV.x - minUV.x)) : 0;
+					packedTexcoords[i + 1] = texcoordScale.y > 0.0f ? QuantizeUnorm16((texcoords[i + 1] - minUV.y) / (maxUV.y - minUV.y)) : 0;
+				}
+
+				ReleaseStream(texcoords);
+			}
+
+			if (quantizePositions && !positions.empty())
+			{
+				RadeonRays::float3 minPos(positions[0], positions[1], positions[2]);
+				RadeonRays::float3 maxPos(positions[0], positions[1], positions[2]);
+
+				for (std::size_t i = 0; i < positions.size(); i += 3)
+				{
+					minPos = RadeonRays::vmin(minPos, RadeonRays::float3(positions[i], positions[i + 1], positions[i + 2]));
+					maxPos = RadeonRays::vmax(maxPos, RadeonRays::float3(positions[i], positions[i + 1], positions[i + 2]));
+				}
+
+				auto extent = maxPos - minPos;
+
+				positionMin = minPos;
+				positionScale = extent * (1.0f / 65535.0f);
+
+				packedPositions.resize(positions.size());
+
+				for (std::size_t i = 0; i < positions.size(); i += 3)
+				{
+					for (std::size_t k = 0; k < 3; k++)
+						packedPositions[i + k] = extent[k] > 0.0f ? QuantizeUnorm16((positions[i + k] - minPos[k]) / extent[k]) : 0;
+				}
+
+				ReleaseStream(positions);
+			}
+		}
+
+		void
+		Mesh::decompress() noexcept
+		{
+			if (!packedNormals.empty())
+			{
+				normals.resize(packedNormals.size() * 3);
+
+				for (std::size_t i = 0; i < packedNormals.size(); i++)
+				{
+					auto n = decodeNormal(packedNormals[i]);
+					normals[i * 3] = n.x;
+					normals[i * 3 + 1] = n.y;
+					normals[i * 3 + 2] = n.z;
+				}
+
+				ReleaseStream(packedNormals);
+			}
+
+			if (!packedTexcoords.empty())
+			{
+				texcoords.resize(packedTexcoords.size());
+
+				for (std::size_t i = 0; i < packedTexcoords.size() / 2; i++)
+				{
+					auto uv = this->getTexcoord((std::int32_t)i);
+					texcoords[i * 2] = uv.x;
+					texcoords[i * 2 + 1] = uv.y;
+				}
+
+				ReleaseStream(packedTexcoords);
+			}
+
+			if (!packedPositions.empty())
+			{
+				this->getPositions(positions);
+				ReleaseStream(packedPositions);
+			}
+		}
+
+		void
+		Mesh::getPositions(std::vector<float>& out) const noexcept
+		{
+			if (packedPositions.empty())
+			{
+				out = positions;
+				return;
+			}
+
+			out.resize(packedPositions.size());
+
+			for (std::size_t i = 0; i < packedPositions.size() / 3; i++)
+			{
+				auto p = this->getPosition((std::int32_t)i);
+				out[i * 3] = p.x;
+				out[i * 3 + 1] = p.y;
+				out[i * 3 + 2] = p.z;
+			}
+		}
+	}
+}
@@ -0,0 +1,339 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		struct VertexKey
+		{
+			float data[8];
+
+			bool operator==(const VertexKey& other) const noexcept
+			{
+				return std::memcmp(data, other.data, sizeof(data)) == 0;
+			}
+		};
+
+		struct VertexKeyHash
+		{
+			std::size_t operator()(const VertexKey& key) const noexcept
+			{
+				// FNV-1a over the raw bits, welding only merges bitwise identical vertices
+				auto bytes = (const std::uint8_t*)key.data;
+				std::size_t hash = 2166136261U;
+				for (std::size_t i = 0; i < sizeof(key.data); i++)
+					hash = (hash ^ bytes[i]) * 16777619U;
+				return hash;
+			}
+		};
+
+		template<typename T>
+		void RemapStream(std::vector<T>& stream, std::size_t components, const std::vector<std::int32_t>& remap, std::size_t count) noexcept
+		{
+			if (stream.empty())
+				return;
+
+			std::vector<T> result(count * components);
+			for (std::size_t i = 0; i < remap.size(); i++)
+			{
+				if (remap[i] >= 0)
+				{
+					for (std::size_t k = 0; k < components; k++)
+						result[remap[i] * components + k] = stream[i * components + k];
+				}
+			}
+
+			stream.swap(result);
+		}
+
+		void RemapVertexStreams(Mesh& mesh, const std::vector<std::int32_t>& remap, std::size_t count) noexcept
+		{
+			RemapStream(mesh.positions, 3, remap, count);
+			RemapStream(mesh.normals, 3, remap, count);
+			RemapStream(mesh.texcoords, 2, remap, count);
+		}
+
+		void PermuteTriangles(Mesh& mesh, const std::vector<std::int32_t>& order) noexcept
+		{
+			std::vector<std::int32_t> indices(mesh.indices.size());
+
+			for (std::size_t i = 0; i < order.size(); i++)
+			{
+				indices[i * 3] = mesh.indices[order[i] * 3];
+				indices[i * 3 + 1] = mesh.indices[order[i] * 3 + 1];
+				indices[i * 3 + 2] = mesh.indices[order[i] * 3 + 2];
+			}
+
+			mesh.indices.swap(indices);
+		}
+
+		std::uint32_t ExpandBits(std::uint32_t v) noexcept
+		{
+			v = (v * 0x00010001u) & 0xFF0000FFu;
+			v = (v * 0x00000101u) & 0x0F00F00Fu;
+			v = (v * 0x00000011u) & 0xC30C30C3u;
+			v = (v * 0x00000005u) & 0x49249249u;
+			return v;
+		}
+
+		std::uint32_t Morton3D(float x, float y, float z) noexcept
+		{
+			auto quantize = [](float t) { return (std::uint32_t)std::min(std::max(t * 1024.0f, 0.0f), 1023.0f); };
+			return ExpandBits(quantize(x)) * 4 + ExpandBits(quantize(y)) * 2 + ExpandBits(quantize(z));
+		}
+
+		void WeldVertices(Mesh& mesh) noexcept
+		{
+			assert(mesh.packedPositions.empty() && mesh.packedNormals.empty() && mesh.packedTexcoords.empty());
+
+			auto numVertices = mesh.getNumVertices();
+
+			std::unordered_map<VertexKey, std::int32_t, VertexKeyHash> cache;
+			cache.reserve(numVertices);
+
+			std::vector<std::int32_t> remap(numVertices);
+			std::vector<std::int32_t> unique(numVertices, -1);
+
+			for (std::size_t i = 0; i < numVertices; i++)
+			{
+				VertexKey key;
+				std::memset(key.data, 0, sizeof(key.data));
+				std::memcpy(key.data, &mesh.positions[i * 3], sizeof(float) * 3);
+				if (!mesh.normals.empty())
+					std::memcpy(key.data + 3, &mesh.normals[i * 3], sizeof(float) * 3);
+				if (!mesh.texcoords.empty())
+					std::memcpy(key.data + 6, &mesh.texcoords[i * 2], sizeof(float) * 2);
+
+				auto it = cache.emplace(key, (std::int32_t)cache.size());
+				if (it.second)
+					unique[i] = it.first->second;
+
+				remap[i] = it.first->second;
+			}
+
+			RemapVertexStreams(mesh, unique, cache.size());
+
+			// triangles that collapsed onto a repeated vertex can never be hit
+			std::size_t count = 0;
+
+			for (std::size_t i = 0; i < mesh.indices.size(); i += 3)
+			{
+				auto a = remap[mesh.indices[i]];
+				auto b = remap[mesh.indices[i + 1]];
+				auto c = remap[mesh.indices[i + 2]];
+
+				if (a != b && b != c && c != a)
+				{
+					mesh.indices[count++] = a;
+					mesh.indices[count++] = b;
+					mesh.indices[count++] = c;
+				}
+			}
+
+			mesh.indices.resize(count);
+		}
+
+		void SortTrianglesSpatially(Mesh& mesh) noexcept
+		{
+			auto numTriangles = mesh.getNumTriangles();
+			if (numTriangles == 0)
+				return;
+
+			std::vector<RadeonRays::float3> centroids(numTriangles);
+
+			RadeonRays::float3 minPos(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+			RadeonRays::float3 maxPos = -minPos;
+
+			for (std::size_t i = 0; i < numTriangles; i++)
+			{
+				auto a = mesh.getPosition(mesh.indices[i * 3]);
+				auto b = mesh.getPosition(mesh.indices[i * 3 + 1]);
+				auto c = mesh.getPosition(mesh.indices[i * 3 + 2]);
+
+				centroids[i] = (a + b + c) * (1.0f / 3.0f);
+				minPos = RadeonRays::vmin(minPos, centroids[i]);
+				maxPos = RadeonRays::vmax(maxPos, centroids[i]);
+			}
+
+			auto extent = maxPos - minPos;
+			auto scale = RadeonRays::float3(
+				extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+				extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+				extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+			std::vector<std::pair<std::uint32_t, std::int32_t>> keys(numTriangles);
+			for (std::size_t i = 0; i < numTriangles; i++)
+			{
+				auto p = (centroids[i] - minPos) * scale;
+				keys[i] = std::make_pair(Morton3D(p.x, p.y, p.z), (std::int32_t)i);
+			}
+
+			std::sort(keys.begin(), keys.end());
+
+			std::vector<std::int32_t> order(numTriangles);
+			for (std::size_t i = 0; i < numTriangles; i++)
+				order[i] = keys[i].second;
+
+			PermuteTriangles(mesh, order);
+		}
+
+		void OptimizeVertexCache(Mesh& mesh, std::uint32_t cacheSize) noexcept
+		{
+			// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+			// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+			const float CacheDecayPower = 1.5f;
+			const float LastTriScore = 0.75f;
+			const float ValenceBoostScale = 2.0f;
+			const float ValenceBoostPower = 0.5f;
+
+			auto numVertices = mesh.getNumVertices();
+			auto numTriangles = mesh.getNumTriangles();
+			if (numTriangles == 0 || cacheSize <= 3)
+				return;
+
+			auto vertexScore = [&](std::int32_t cachePosition, std::uint32_t valence)
+			{
+				if (valence == 0)
+					return -1.0f;
+
+				float score = 0.0f;
+				if (cachePosition >= 0)
+				{
+					if (cachePosition < 3)
+						score = LastTriScore;
+					else
+						score = std::pow(1.0f - float(cachePosition - 3) / (cacheSize - 3), CacheDecayPower);
+				}
+
+				return score + ValenceBoostScale * std::pow((float)valence, -ValenceBoostPower);
+			};
+
+			std::vector<std::uint32_t> valence(numVertices, 0);
+			for (auto index : mesh.indices)
+				valence[index]++;
+
+			std::vector<std::uint32_t> offsets(numVertices + 1, 0);
+			for (std::size_t i = 0; i < numVertices; i++)
+				offsets[i + 1] = offsets[i] + valence[i];
+
+			std::vector<std::int32_t> adjacency(mesh.indices.size());
+			std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (std::size_t i = 0; i < mesh.indices.size(); i++)
+				adjacency[fill[mesh.indices[i]]++] = (std::int32_t)(i / 3);
+
+			std::vector<std::int32_t> cachePosition(numVertices, -1);
+			std::vector<float> score(numVertices);
+			for (std::size_t i = 0; i < numVertices; i++)
+				score[i] = vertexScore(-1, valence[i]);
+
+			std::vector<float> triangleScore(numTriangles);
+			std::vector<bool> emitted(numTriangles, false);
+			for (std::size_t i = 0; i < numTriangles; i++)
+				triangleScore[i] = score[mesh.indices[i * 3]] + score[mesh.indices[i * 3 + 1]] + score[mesh.indices[i * 3 + 2]];
+
+			std::vector<std::int32_t> cache;
+			std::vector<std::int32_t> nextCache;
+			cache.reserve(cacheSize + 3);
+			nextCache.reserve(cacheSize + 3);
+
+			std::vector<std::int32_t> order;
+			order.reserve(numTriangles);
+
+			std::int32_t best = -1;
+			std::size_t cursor = 0;
+
+			while (order.size() < numTriangles)
+			{
+				if (best < 0)
+				{
+					while (emitted[cursor])
+						cursor++;
+					best = (std::int32_t)cursor;
+				}
+
+				order.push_back(best);
+				emitted[best] = true;
+
+				nextCache.clear();
+
+				for (std::size_t k = 0; k < 3; k++)
+				{
+					auto v = mesh.indices[best * 3 + k];
+					nextCache.push_back(v);
+
+					// drop the emitted triangle from the live adjacency of the vertex
+					auto begin = adjacency.begin() + offsets[v];
+					auto end = begin + valence[v];
+					std::iter_swap(std::find(begin, end, best), end - 1);
+					valence[v]--;
+				}
+
+				for (auto v : cache)
+				{
+					if (v != nextCache[0] && v != nextCache[1] && v != nextCache[2])
+						nextCache.push_back(v);
+				}
+
+				for (std::size_t i = 0; i < nextCache.size(); i++)
+				{
+					auto v = nextCache[i];
+					cachePosition[v] = i < cacheSize ? (std::int32_t)i : -1;
+					score[v] = vertexScore(cachePosition[v], valence[v]);
+				}
+
+				if (nextCache.size() > cacheSize)
+					nextCache.resize(cacheSize);
+
+				cache.swap(nextCache);
+
+				best = -1;
+				float bestScore = -1.0f;
+
+				for (auto v : cache)
+				{
+					for (std::uint32_t i = 0; i < valence[v]; i++)
+					{
+						auto t = adjacency[offsets[v] + i];
+						triangleScore[t] = score[mesh.indices[t * 3]] + score[mesh.indices[t * 3 + 1]] + score[mesh.indices[t * 3 + 2]];
+
+						if (triangleScore[t] > bestScore)
+						{
+							bestScore = triangleScore[t];
+							best = t;
+						}
+					}
+				}
+			}
+
+			PermuteTriangles(mesh, order);
+		}
+
+		void OptimizeVertexFetch(Mesh& mesh) noexcept
+		{
+			std::vector<std::int32_t> remap(mesh.getNumVertices(), -1);
+			std::int32_t count = 0;
+
+			for (auto& index : mesh.indices)
+			{
+				if (remap[index] < 0)
+					remap[index] = count++;
+				index = remap[index];
+			}
+
+			RemapVertexStreams(mesh, remap, count);
+		}
+
+		void OptimizeMesh(Mesh& mesh) noexcept
+		{
+			WeldVertices(mesh);
+			SortTrianglesSpatially(mesh);
+			OptimizeVertexCache(mesh);
+			OptimizeVertexFetch(mesh);
+		}
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef OCTOON_CAUSTIC_MESH_OPTIMIZER_H_
+#define OCTOON_CAUSTIC_MESH_OPTIMIZER_H_
+
+#include <octoon/caustic/mesh.h>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		// All passes work on the float streams, so they have to run before Mesh::compress().
+		void WeldVertices(Mesh& mesh) noexcept;
+		void SortTrianglesSpatially(Mesh& mesh) noexcept;
+		void OptimizeVertexCache(Mesh& mesh, std::uint32_t cacheSize = 32) noexcept;
+		void OptimizeVertexFetch(Mesh& mesh) noexcept;
+
+		void OptimizeMesh(Mesh& mesh) noexcept;
+	}
+}
+
+#endif
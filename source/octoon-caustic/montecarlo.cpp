@@ -4,13 +4,18 @@
 #include <assert.h>
 #include <atomic>
 #include <string>
-#include <CL/cl.h>
+#include <unordered_map>
 
 #include <octoon/caustic/ACES.h>
+#include <octoon/caustic/geometry_instance.h>
 
 #include "disney.h"
 #include "halton.h"
 #include "cranley_patterson.h"
+#include "native_intersector.h"
+#if defined(OCTOON_BUILD_RADEON_RAYS)
+#	include "radeon_rays_intersector.h"
+#endif
 
 namespace octoon
 {
@@ -32,60 +37,77 @@ namespace octoon
 			return attenuation;
 		}
 
-		RadeonRays::float3 InterpolateVertices(const float* vec, const int* indices, int prim_id, const RadeonRays::float4& barycentrics)
+		RadeonRays::float3 InterpolateVertices(const Mesh& mesh, int prim_id, const RadeonRays::float4& barycentrics)
 		{
-			auto i0 = indices[prim_id * 3];
-			auto i1 = indices[prim_id * 3 + 1];
-			auto i2 = indices[prim_id * 3 + 2];
+			auto i0 = mesh.indices[prim_id * 3];
+			auto i1 = mesh.indices[prim_id * 3 + 1];
+			auto i2 = mesh.indices[prim_id * 3 + 2];
 
-			RadeonRays::float3 a(vec[i0 * 3], vec[i0 * 3 + 1], vec[i0 * 3 + 2]);
-			RadeonRays::float3 b(vec[i1 * 3], vec[i1 * 3 + 1], vec[i1 * 3 + 2]);
-			RadeonRays::float3 c(vec[i2 * 3], vec[i2 * 3 + 1], vec[i2 * 3 + 2]);
+			auto a = mesh.getPosition(i0);
+			auto b = mesh.getPosition(i1);
+			auto c = mesh.getPosition(i2);
 
 			return a * (1 - barycentrics.x - barycentrics.y) + b * barycentrics.x + c * barycentrics.y;
 		}
 
-		RadeonRays::float3 InterpolateNormals(const float* vec, const int* indices, int prim_id, const RadeonRays::float4& barycentrics)
+		RadeonRays::float3 InterpolateNormals(const Mesh& mesh, int prim_id, const RadeonRays::float4& barycentrics)
 		{
-			return RadeonRays::normalize(InterpolateVertices(vec, indices, prim_id, barycentrics));
+			auto i0 = mesh.indices[prim_id * 3];
+			auto i1 = mesh.indices[prim_id * 3 + 1];
+			auto i2 = mesh.indices[prim_id * 3 + 2];
+
+			auto a = mesh.getNormal(i0);
+			auto b = mesh.getNormal(i1);
+			auto c = mesh.getNormal(i2);
+
+			return RadeonRays::normalize(a * (1 - barycentrics.x - barycentrics.y) + b * barycentrics.x + c * barycentrics.y);
+		}
+
+		RadeonRays::float3 GetPosition(const ShapeData& shape, const RadeonRays::Intersection& hit, float time)
+		{
+			auto p = InterpolateVertices(*shape.mesh, hit.primid, hit.uvwt);
+			if (shape.motion)
+				return TransformPoint(p, InterpolateTransform(shape.transform, shape.motionTransform, time));
+			return TransformPoint(p, shape.transform);
+		}
+
+		RadeonRays::float3 GetNormal(const ShapeData& shape, const RadeonRays::Intersection& hit, float time)
+		{
+			auto n = InterpolateNormals(*shape.mesh, hit.primid, hit.uvwt);
+			if (shape.motion)
+				return TransformNormal(n, AffineInverse(InterpolateTransform(shape.transform, shape.motionTransform, time)));
+			return TransformNormal(n, shape.transformInverse);
 		}
 
 		MonteCarlo::MonteCarlo() noexcept
 			: numBounces_(6)
-			, tileNums_(0)
+			, shapesRevision_(std::numeric_limits<std::uint32_t>::max())
 			, width_(0)
 			, height_(0)
-			, api_(nullptr)
 		{
 			renderData_.numEstimate = 0;
-			renderData_.fr_rays = nullptr;
-			renderData_.fr_hits = nullptr;
-			renderData_.fr_shadowrays = nullptr;
-			renderData_.fr_shadowhits = nullptr;
+			renderData_.numPixels = 0;
+
+			defaultMaterial_.albedo = RadeonRays::float3(0.5f, 0.5f, 0.5f);
+			defaultMaterial_.specular = RadeonRays::float3(0.04f, 0.04f, 0.04f);
+			defaultMaterial_.emissive = RadeonRays::float3(0.0f, 0.0f, 0.0f);
+			defaultMaterial_.ior = 1.0f;
+			defaultMaterial_.roughness = 1.0f;
+			defaultMaterial_.metalness = 0.0f;
 		}
 
-		MonteCarlo::MonteCarlo(std::uint32_t w, std::uint32_t h) noexcept
+		MonteCarlo::MonteCarlo(std::uint32_t w, std::uint32_t h, TraversalBackend backend) noexcept
 			: MonteCarlo()
 		{
-			this->setup(w, h);
+			this->setup(w, h, backend);
 		}
 
 		MonteCarlo::~MonteCarlo() noexcept
 		{
-			if (renderData_.fr_rays)
-				api_->DeleteBuffer(renderData_.fr_rays);
-			if (renderData_.fr_hits)
-				api_->DeleteBuffer(renderData_.fr_hits);
-			if (renderData_.fr_shadowhits)
-				api_->DeleteBuffer(renderData_.fr_shadowhits);
-			if (renderData_.fr_shadowrays)
-				api_->DeleteBuffer(renderData_.fr_shadowrays);
-			if (api_)
-				RadeonRays::IntersectionApi::Delete(api_);
 		}
 
 		void
-		MonteCarlo::setup(std::uint32_t w, std::uint32_t h) noexcept(false)
+		MonteCarlo::setup(std::uint32_t w, std::uint32_t h, TraversalBackend backend) noexcept(false)
 		{
 			width_ = w;
 			height_ = h;
@@ -93,166 +115,138 @@ namespace octoon
 			tonemapping_ = std::make_unique<caustic::ACES>();
 			sequences_ = std::make_unique<caustic::CranleyPatterson>(std::make_unique<caustic::Halton>(), width_ * height_);
 
-			if (!init_data()) throw std::runtime_error("init_data() fail");
-			if (!init_Gbuffers(w, h)) throw std::runtime_error("init_Gbuffers() fail");
-			if (!init_RadeonRays()) throw std::runtime_error("init_RadeonRays() fail");
-			if (!init_RadeonRays_Scene()) throw std::runtime_error("init_RadeonRays_Scene() fail");
-		}
-
-		bool
-		MonteCarlo::init_Gbuffers(std::uint32_t, std::uint32_t h) noexcept
-		{
-			auto allocSize = width_ * height_;
-			ldr_.resize(allocSize);
-			hdr_.resize(allocSize);
-
-			return true;
-		}
-
-		bool
-		MonteCarlo::init_RadeonRays() noexcept
-		{
-			RadeonRays::IntersectionApi::SetPlatform(RadeonRays::DeviceInfo::kAny);
-
-			auto deviceidx = std::string::npos;
-			for (auto i = 0U; i < RadeonRays::IntersectionApi::GetDeviceCount(); ++i)
+			if (backend == TraversalBackend::RadeonRays)
 			{
-				RadeonRays::DeviceInfo devinfo;
-				RadeonRays::IntersectionApi::GetDeviceInfo(i, devinfo);
-
-				if (devinfo.type == RadeonRays::DeviceInfo::kGpu)
-				{
-					std::string info_name(devinfo.name);
-					if (info_name.find("Intel") != std::string::npos)
-						continue;
-					deviceidx = i;
-					break;
-				}
+#if defined(OCTOON_BUILD_RADEON_RAYS)
+				auto api = RenderScene::instance().getIntersectionApi();
+				if (!api) throw std::runtime_error("RenderScene::getIntersectionApi() fail");
+
+				intersector_ = std::make_unique<RadeonRaysIntersector>(api);
+#else
+				throw std::runtime_error("MonteCarlo::setup() RadeonRays backend is not built");
+#endif
 			}
-
-			if (deviceidx == std::string::npos)
+			else
 			{
-				for (auto i = 0U; i < RadeonRays::IntersectionApi::GetDeviceCount(); ++i)
-				{
-					RadeonRays::DeviceInfo devinfo;
-					RadeonRays::IntersectionApi::GetDeviceInfo(i, devinfo);
-
-					if (devinfo.type == RadeonRays::DeviceInfo::kCpu)
-					{
-						deviceidx = i;
-						break;
-					}
-				}
+				intersector_ = std::make_unique<NativeIntersector>();
 			}
 
-			if (deviceidx == std::string::npos) return false;
-
-			this->api_ = RadeonRays::IntersectionApi::Create(deviceidx);
-			return this->api_ != nullptr;
+			shapesRevision_ = std::numeric_limits<std::uint32_t>::max();
 		}
 
-		bool
-		MonteCarlo::init_data()
+		void
+		MonteCarlo::setIntersector(std::unique_ptr<Intersector>&& intersector) noexcept
 		{
-			std::string basepath = "../Resources/CornellBox/";
-			std::string filename = basepath + "orig.objm";
-
-			std::vector<tinyobj::material_t> material;
-			std::string res = LoadObj(scene_, material, filename.c_str(), basepath.c_str());
-
-			for (auto& it : material)
-			{
-				caustic::Material m;
-				m.albedo.x = std::pow(it.diffuse[0], 2.2f);
-				m.albedo.y = std::pow(it.diffuse[1], 2.2f);
-				m.albedo.z = std::pow(it.diffuse[2], 2.2f);
-
-				m.specular.x = std::pow(it.specular[0], 2.2f) * 0.04f;
-				m.specular.y = std::pow(it.specular[1], 2.2f) * 0.04f;
-				m.specular.z = std::pow(it.specular[2], 2.2f) * 0.04f;
-
-				m.emissive.x = it.emission[0];
-				m.emissive.y = it.emission[1];
-				m.emissive.z = it.emission[2];
-
-				m.ior = it.ior;
-				m.metalness = saturate(it.dissolve);
-				m.roughness = std::max(0.02f, saturate(it.shininess));
-
-				materials_.push_back(m);
-			}
+			intersector_ = std::move(intersector);
+			shapesRevision_ = std::numeric_limits<std::uint32_t>::max();
+		}
 
-			return res.empty();
+		Intersector*
+		MonteCarlo::getIntersector() const noexcept
+		{
+			return intersector_.get();
 		}
 
 		bool
-		MonteCarlo::init_RadeonRays_Scene()
+		MonteCarlo::getTraversalStats(TraversalStats& stats) const noexcept
 		{
-			for (int id = 0; id < this->scene_.size(); ++id)
-			{
-				tinyobj::shape_t& objshape = this->scene_[id];
-
-				float* vertdata = objshape.mesh.positions.data();
-				std::size_t nvert = objshape.mesh.positions.size() / 3;
-				int* indices = objshape.mesh.indices.data();
-				std::size_t nfaces = objshape.mesh.indices.size() / 3;
-
-				RadeonRays::Shape* shape = this->api_->CreateMesh(vertdata, (int)nvert, 3 * sizeof(float), indices, 0, nullptr, (int)nfaces);
-
-				assert(shape != nullptr);
-				this->api_->AttachShape(shape);
-
-				shape->SetId(id);
-			}
-
-			this->api_->Commit();
-
-			return true;
+			return intersector_ ? intersector_->getStats(stats) : false;
 		}
 
 		const std::uint32_t*
 		MonteCarlo::data() const noexcept
 		{
-			return ldr_.data();
+			auto& cameras = RenderScene::instance().getCameraList();
+			if (cameras.empty() || !cameras.front()->getFilm())
+				return nullptr;
+
+			return cameras.front()->getFilm()->data();
 		}
 
 		void
 		MonteCarlo::GenerateWorkspace(std::int32_t numEstimate)
 		{
-			if (tileNums_ < numEstimate)
-			{
-				renderData_.hits.resize(numEstimate);
-				renderData_.samples.resize(numEstimate);
-				renderData_.samplesAccum.resize(numEstimate);
-				renderData_.random.resize(numEstimate);
-				renderData_.weights.resize(numEstimate);
-				renderData_.shadowRays.resize(numEstimate);
-				renderData_.shadowHits.resize(numEstimate);
+			// every transient buffer of the tile comes from one block, which is only replaced for a larger tile
+			std::size_t count = numEstimate;
+			workspace_.reserve(
+				Arena::sizeOf<RadeonRays::ray>(count) * 3 +
+				Arena::sizeOf<RadeonRays::Intersection>(count) * 2 +
+				Arena::sizeOf<RadeonRays::float3>(count) * 6 +
+				Arena::sizeOf<RadeonRays::float2>(count) * 2 +
+				Arena::sizeOf<float>(count) * 2 +
+				Arena::sizeOf<std::int32_t>(count) * 2);
+
+			renderData_.rays[0] = workspace_.allocate<RadeonRays::ray>(count);
+			renderData_.rays[1] = workspace_.allocate<RadeonRays::ray>(count);
+			renderData_.shadowRays = workspace_.allocate<RadeonRays::ray>(count);
+			renderData_.hits = workspace_.allocate<RadeonRays::Intersection>(count);
+			renderData_.shadowHits = workspace_.allocate<RadeonRays::Intersection>(count);
+			renderData_.samples = workspace_.allocate<RadeonRays::float3>(count);
+			renderData_.samplesAccum = workspace_.allocate<RadeonRays::float3>(count);
+			renderData_.weights = workspace_.allocate<RadeonRays::float3>(count);
+			renderData_.normals = workspace_.allocate<RadeonRays::float3>(count);
+			renderData_.albedo = workspace_.allocate<RadeonRays::float3>(count);
+			renderData_.direct = workspace_.allocate<RadeonRays::float3>(count);
+			renderData_.random = workspace_.allocate<RadeonRays::float2>(count);
+			renderData_.lens = workspace_.allocate<RadeonRays::float2>(count);
+			renderData_.times = workspace_.allocate<float>(count);
+			renderData_.depth = workspace_.allocate<float>(count);
+			renderData_.shapeIds = workspace_.allocate<std::int32_t>(count);
+			renderData_.materialIds = workspace_.allocate<std::int32_t>(count);
 
-				renderData_.rays[0].resize(numEstimate);
-				renderData_.rays[1].resize(numEstimate);
+			this->renderData_.numEstimate = numEstimate;
+		}
+
+		void
+		MonteCarlo::GenerateShapeData() noexcept
+		{
+			auto& scene = RenderScene::instance();
 
-				if (renderData_.fr_rays)
-					api_->DeleteBuffer(renderData_.fr_rays);
+			// called for every tile, the objects only need a walk after the scene changed
+			auto revision = scene.getRevision();
+			if (revision == shapesRevision_)
+				return;
 
-				if (renderData_.fr_hits)
-					api_->DeleteBuffer(renderData_.fr_hits);
+			shapes_.assign(scene.getShapeCount(), ShapeData());
 
-				if (renderData_.fr_shadowrays)
-					api_->DeleteBuffer(renderData_.fr_shadowrays);
+			std::unordered_map<const Material*, std::int32_t> materials;
 
-				if (renderData_.fr_shadowhits)
-					api_->DeleteBuffer(renderData_.fr_shadowhits);
+			for (auto& object : scene.getRenderObjects())
+			{
+				std::int32_t id = RadeonRays::kNullId;
+				const Geometry* geometry = nullptr;
+				const Material* material = nullptr;
 
-				renderData_.fr_rays = api_->CreateBuffer(sizeof(RadeonRays::ray) * numEstimate, nullptr);
-				renderData_.fr_hits = api_->CreateBuffer(sizeof(RadeonRays::Intersection) * numEstimate, nullptr);
-				renderData_.fr_shadowrays = api_->CreateBuffer(sizeof(RadeonRays::ray) * numEstimate, nullptr);
-				renderData_.fr_shadowhits = api_->CreateBuffer(sizeof(RadeonRays::Intersection) * numEstimate, nullptr);
+				if (object->isA<Geometry>())
+				{
+					geometry = object->downcast<Geometry>();
+					id = geometry->getShapeId();
+					material = geometry->getMaterial().get();
+				}
+				else if (object->isA<GeometryInstance>())
+				{
+					auto instance = object->downcast<GeometryInstance>();
+					geometry = instance->getGeometry().get();
+					id = instance->getShapeId();
+					material = instance->getMaterial().get();
+				}
 
-				tileNums_ = numEstimate;
+				if (id == RadeonRays::kNullId || !geometry->getMesh())
+					continue;
+
+				auto& shape = shapes_[id];
+				shape.mesh = geometry->getMesh();
+				shape.material = material ? material : &defaultMaterial_;
+				shape.materialId = materials.emplace(shape.material, (std::int32_t)materials.size()).first->second;
+				shape.transform = object->getTransform();
+				shape.transformInverse = object->getTransformInverse();
+				shape.motionTransform = object->getMotionTransform();
+				shape.motionTransformInverse = object->getMotionTransformInverse();
+				shape.motion = object->hasMotion();
 			}
 
-			this->renderData_.numEstimate = numEstimate;
+			intersector_->commit(shapes_, revision);
+			shapesRevision_ = revision;
 		}
 
 		void
@@ -261,63 +255,51 @@ namespace octoon
 	#pragma omp parallel for
 			for (std::int32_t i = 0; i < this->renderData_.numEstimate; ++i)
 			{
-				auto ix = offset.x + i % size.x;
-				auto iy = offset.y + i / size.x;
+				auto pixel = i % this->renderData_.numPixels;
+				auto ix = offset.x + pixel % size.x;
+				auto iy = offset.y + pixel / size.x;
 				auto index = iy * this->width_ + ix;
 
 				float sx = sequences_->sample(0, frame, index);
 				float sy = sequences_->sample(1, frame, index);
 
 				this->renderData_.random[i] = RadeonRays::float2(sx, sy);
+				this->renderData_.times[i] = sequences_->sample(2, frame, index);
+				this->renderData_.lens[i] = RadeonRays::float2(sequences_->sample(3, frame, index), sequences_->sample(4, frame, index));
 			}
 		}
 
 		void
-		MonteCarlo::GenerateCamera(const Camera& camera, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept
+		MonteCarlo::GenerateCamera(const std::vector<Camera*>& cameras, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept
 		{
-			RadeonRays::ray* rays = nullptr;
-			RadeonRays::Event* e = nullptr;
-			api_->MapBuffer(renderData_.fr_rays, RadeonRays::kMapWrite, 0, sizeof(RadeonRays::ray) * this->renderData_.numEstimate, (void**)&rays, &e); e->Wait(); api_->DeleteEvent(e);
-
-			float aspect = (float)width_ / height_;
-			float xstep = 2.0f / (float)this->width_;
-			float ystep = 2.0f / (float)this->height_;
+			// without backend support the shapes stay at their start transform, so shading has to as well
+			bool motionBlur = intersector_->hasMotionBlur();
 
-	#pragma omp parallel for
-			for (std::int32_t i = 0; i < this->renderData_.numEstimate; ++i)
+			for (std::size_t c = 0; c < cameras.size(); c++)
 			{
-				auto ix = offset.x + i % size.x;
-				auto iy = offset.y + i / size.x;
+				auto& camera = *cameras[c];
+				auto first = c * this->renderData_.numPixels;
 
-				float x = xstep * ix - 1.0f + (renderData_.random[i].x * 2 - 1) / (float)this->width_;
-				float y = ystep * iy - 1.0f + (renderData_.random[i].y * 2 - 1) / (float)this->height_;
-				float z = 1.0f;
+				// the whole path of a sample is traced at the same time within the shutter interval
+	#pragma omp parallel for
+				for (std::int32_t i = 0; i < this->renderData_.numPixels; ++i)
+				{
+					auto& time = renderData_.times[first + i];
+					time = motionBlur ? lerp(camera.getShutterOpen(), camera.getShutterClose(), time) : 0.0f;
+				}
 
-				auto& ray = rays[i];
-				ray.o = camera.getTranslate();
-				ray.d = RadeonRays::normalize(RadeonRays::float3(x * aspect, y, z - ray.o.z));
-				ray.SetMaxT(std::numeric_limits<float>::max());
-				ray.SetTime(0.0f);
-				ray.SetMask(-1);
-				ray.SetActive(true);
-				ray.SetDoBackfaceCulling(true);
+				camera.generateRays(
+					RadeonRays::int2(width_, height_), offset, size,
+					renderData_.random + first,
+					renderData_.lens + first,
+					renderData_.times + first,
+					renderData_.rays[0] + first);
 			}
-
-			std::memcpy(renderData_.rays[0].data(), rays, sizeof(RadeonRays::ray) * this->renderData_.numEstimate);
-
-			api_->UnmapBuffer(renderData_.fr_rays, rays, &e); e->Wait(); api_->DeleteEvent(e);
 		}
 
 		void
 		MonteCarlo::GenerateRays(std::uint32_t pass) noexcept
 		{
-			RadeonRays::ray* data = nullptr;
-			RadeonRays::Event* e = nullptr;
-			api_->MapBuffer(renderData_.fr_rays, RadeonRays::kMapWrite, 0, sizeof(RadeonRays::ray) * this->renderData_.numEstimate, (void**)&data, &e); e->Wait(); api_->DeleteEvent(e);
-
-			std::memset(renderData_.weights.data(), 0, sizeof(RadeonRays::float3) * this->renderData_.numEstimate);
-			std::memset(renderData_.rays[(pass & 1) ^ 1].data(), 0, sizeof(RadeonRays::ray) * this->renderData_.numEstimate);
-
 			auto& rays = renderData_.rays[(pass & 1) ^ 1];
 			auto& views = renderData_.rays[pass & 1];
 
@@ -328,16 +310,21 @@ namespace octoon
 				auto& ray = rays[i];
 				auto& view = views[i];
 
+				// cleared here rather than in a pass of its own, the loop writes the sample anyway
+				ray = RadeonRays::ray();
+				ray.SetActive(false);
+				renderData_.weights[i] = RadeonRays::float3(0.0f, 0.0f, 0.0f, 0.0f);
+
 				if (hit.shapeid != RadeonRays::kNullId && hit.primid != RadeonRays::kNullId)
 				{
-					auto& mesh = scene_[hit.shapeid].mesh;
-					auto& mat = materials_[mesh.material_ids[hit.primid]];
+					auto& shape = shapes_[hit.shapeid];
+					auto& mat = *shape.material;
 
 					if (mat.isEmissive())
 						continue;
 
-					auto ro = InterpolateVertices(mesh.positions.data(), mesh.indices.data(), hit.primid, hit.uvwt);
-					auto norm = InterpolateNormals(mesh.normals.data(), mesh.indices.data(), hit.primid, hit.uvwt);
+					auto ro = GetPosition(shape, hit, renderData_.times[i]);
+					auto norm = GetNormal(shape, hit, renderData_.times[i]);
 
 					RadeonRays::float3 L;
 					renderData_.weights[i] = Disney_Sample(norm, -view.d, mat, renderData_.random[i], L);
@@ -346,41 +333,39 @@ namespace octoon
 					ray.d = L;
 					ray.o = ro + L * 1e-5f;
 					ray.SetMaxT(std::numeric_limits<float>::max());
-					ray.SetTime(0.0f);
+					ray.SetTime(renderData_.times[i]);
 					ray.SetMask(-1);
 					ray.SetActive(true);
 					ray.SetDoBackfaceCulling(mat.ior > 1.0f ? false : true);
 				}
 			}
-
-			std::memcpy(data, renderData_.rays[(pass & 1) ^ 1].data(), sizeof(RadeonRays::ray) * this->renderData_.numEstimate);
-
-			api_->UnmapBuffer(renderData_.fr_rays, data, &e); e->Wait(); api_->DeleteEvent(e);
 		}
 
 		void
-		MonteCarlo::GenerateLightRays(const Light& light) noexcept
+		MonteCarlo::GenerateLightRays(const std::vector<Camera*>& cameras, const Light& light) noexcept
 		{
-			RadeonRays::ray* rays = nullptr;
-			RadeonRays::Event* e = nullptr;
-			api_->MapBuffer(renderData_.fr_shadowrays, RadeonRays::kMapWrite, 0, sizeof(RadeonRays::ray) * this->renderData_.numEstimate, (void**)&rays, &e); e->Wait(); api_->DeleteEvent(e);
-
-			std::memset(renderData_.shadowRays.data(), 0, sizeof(RadeonRays::ray) * this->renderData_.numEstimate);
-
 #pragma omp parallel for
 			for (std::int32_t i = 0; i < this->renderData_.numEstimate; ++i)
 			{
+				// a default ray is active, only the ones given a light sample below are traced
+				renderData_.shadowRays[i] = RadeonRays::ray();
+				renderData_.shadowRays[i].SetActive(false);
+
+				// lights only reach the cameras on their layer
+				if (cameras[i / this->renderData_.numPixels]->getLayer() != light.getLayer())
+					continue;
+
 				auto& hit = renderData_.hits[i];
 				if (hit.shapeid != RadeonRays::kNullId && hit.primid != RadeonRays::kNullId)
 				{
-					auto& mesh = scene_[hit.shapeid].mesh;
-					auto& mat = materials_[mesh.material_ids[hit.primid]];
+					auto& shape = shapes_[hit.shapeid];
+					auto& mat = *shape.material;
 
 					if (mat.isEmissive())
 						continue;
 					
-					auto ro = InterpolateVertices(mesh.positions.data(), mesh.indices.data(), hit.primid, hit.uvwt);
-					auto norm = InterpolateNormals(mesh.normals.data(), mesh.indices.data(), hit.primid, hit.uvwt);
+					auto ro = GetPosition(shape, hit, renderData_.times[i]);
+					auto norm = GetNormal(shape, hit, renderData_.times[i]);
 
 					RadeonRays::float4 L = light.sample(ro, norm, mat, renderData_.random[i]);
 					assert(std::isfinite(L[0] + L[1] + L[2]));
@@ -391,59 +376,41 @@ namespace octoon
 						ray.d = RadeonRays::float3(L[0], L[1], L[2]);
 						ray.o = ro + ray.d * 1e-5f;
 						ray.SetMaxT(L.w);
-						ray.SetTime(0.0f);
+						ray.SetTime(renderData_.times[i]);
 						ray.SetMask(-1);
 						ray.SetActive(true);
 						ray.SetDoBackfaceCulling(mat.ior > 1.0f ? false : true);
 					}
 				}
 			}
-
-			std::memcpy(rays, renderData_.shadowRays.data(), sizeof(RadeonRays::ray) * this->renderData_.numEstimate);
-
-			api_->UnmapBuffer(renderData_.fr_shadowrays, rays, &e); e->Wait(); api_->DeleteEvent(e);
 		}
 
 		void
-		MonteCarlo::GatherHits() noexcept
+		MonteCarlo::GatherHits(std::uint32_t pass) noexcept
 		{
-			RadeonRays::Event* e = nullptr;
-			RadeonRays::Intersection* hit = nullptr;
-
-			api_->MapBuffer(renderData_.fr_hits, RadeonRays::kMapRead, 0, sizeof(RadeonRays::Intersection) * this->renderData_.numEstimate, (void**)&hit, &e); e->Wait(); api_->DeleteEvent(e);
-
-			std::memcpy(renderData_.hits.data(), hit, sizeof(RadeonRays::Intersection) * this->renderData_.numEstimate);
-
-			api_->UnmapBuffer(renderData_.fr_hits, hit, &e); e->Wait(); api_->DeleteEvent(e);
+			intersector_->intersect(renderData_.rays[pass & 1], renderData_.hits, this->renderData_.numEstimate);
 		}
 
 		void
 		MonteCarlo::GatherShadowHits() noexcept
 		{
-			RadeonRays::Event* e = nullptr;
-			RadeonRays::Intersection* hit = nullptr;
-
-			api_->MapBuffer(renderData_.fr_shadowhits, RadeonRays::kMapRead, 0, sizeof(RadeonRays::Intersection) * this->renderData_.numEstimate, (void**)&hit, &e); e->Wait(); api_->DeleteEvent(e);
-
-			std::memcpy(renderData_.shadowHits.data(), hit, sizeof(RadeonRays::Intersection) * this->renderData_.numEstimate);
-
-			api_->UnmapBuffer(renderData_.fr_shadowhits, hit, &e); e->Wait(); api_->DeleteEvent(e);
+			intersector_->occlude(renderData_.shadowRays, renderData_.shadowHits, this->renderData_.numEstimate);
 		}
 
 		void
 		MonteCarlo::GatherFirstSampling() noexcept
 		{
-			std::memset(renderData_.samples.data(), 0, sizeof(RadeonRays::float3) * this->renderData_.numEstimate);
-			std::memset(renderData_.samplesAccum.data(), 0, sizeof(RadeonRays::float3) * this->renderData_.numEstimate);
-
 	#pragma omp parallel for
 			for (std::int32_t i = 0; i < this->renderData_.numEstimate; ++i)
 			{
+				renderData_.samples[i] = RadeonRays::float3(0.0f, 0.0f, 0.0f, 0.0f);
+				renderData_.samplesAccum[i] = RadeonRays::float3(0.0f, 0.0f, 0.0f, 0.0f);
+
 				auto& hit = renderData_.hits[i];
 				if (hit.shapeid != RadeonRays::kNullId)
 				{
-					auto& mesh = scene_[hit.shapeid].mesh;
-					auto& mat = materials_[mesh.material_ids[hit.primid]];
+					auto& shape = shapes_[hit.shapeid];
+					auto& mat = *shape.material;
 
 					if (mat.isEmissive())
 						renderData_.samplesAccum[i] += mat.emissive;
@@ -451,6 +418,36 @@ namespace octoon
 					renderData_.samples[i] = RadeonRays::float3(1, 1, 1);
 				}					
 			}
+
+			if (!renderData_.aovs)
+				return;
+
+	#pragma omp parallel for
+			for (std::int32_t i = 0; i < this->renderData_.numEstimate; ++i)
+			{
+				auto& hit = renderData_.hits[i];
+				if (hit.shapeid != RadeonRays::kNullId)
+				{
+					auto& shape = shapes_[hit.shapeid];
+					auto& ray = renderData_.rays[0][i];
+
+					renderData_.depth[i] = std::sqrt((GetPosition(shape, hit, renderData_.times[i]) - ray.o).sqnorm());
+					renderData_.normals[i] = GetNormal(shape, hit, renderData_.times[i]);
+					renderData_.albedo[i] = shape.material->albedo;
+					renderData_.shapeIds[i] = hit.shapeid;
+					renderData_.materialIds[i] = shape.materialId;
+					renderData_.direct[i] = renderData_.samplesAccum[i];
+				}
+				else
+				{
+					renderData_.depth[i] = 0.0f;
+					renderData_.normals[i] = RadeonRays::float3(0.0f, 0.0f, 0.0f);
+					renderData_.albedo[i] = RadeonRays::float3(0.0f, 0.0f, 0.0f);
+					renderData_.shapeIds[i] = -1;
+					renderData_.materialIds[i] = -1;
+					renderData_.direct[i] = RadeonRays::float3(0.0f, 0.0f, 0.0f);
+				}
+			}
 		}
 
 		void
@@ -462,10 +459,10 @@ namespace octoon
 				auto& hit = renderData_.hits[i];
 				if (hit.shapeid != RadeonRays::kNullId)
 				{
-					auto& mesh = scene_[hit.shapeid].mesh;
-					auto& mat = materials_[mesh.material_ids[hit.primid]];
+					auto& shape = shapes_[hit.shapeid];
+					auto& mat = *shape.material;
 
-					auto ro = InterpolateVertices(mesh.positions.data(), mesh.indices.data(), hit.primid, hit.uvwt);
+					auto ro = GetPosition(shape, hit, renderData_.times[i]);
 					auto atten = GetPhysicalLightAttenuation(renderData_.rays[pass & 1][i].o - ro);
 					
 					assert(renderData_.weights[i].w > 0);
@@ -497,36 +494,40 @@ namespace octoon
 					if (shadowHit.shapeid != RadeonRays::kNullId)
 						continue;
 
-					auto& mesh = scene_[hit.shapeid].mesh;
-					auto& mat = materials_[mesh.material_ids[hit.primid]];
+					auto& shape = shapes_[hit.shapeid];
+					auto& mat = *shape.material;
 
-					auto norm = InterpolateNormals(mesh.normals.data(), mesh.indices.data(), hit.primid, hit.uvwt);
+					auto norm = GetNormal(shape, hit, renderData_.times[i]);
 					auto sample = renderData_.samples[i] * light.Li(norm, -views[i].d, rays[i].d, mat, renderData_.random[i]);
 
-					renderData_.samplesAccum[i] += sample * (1.0f / (rays[i].GetMaxT() * rays[i].GetMaxT()));
+					sample *= 1.0f / (rays[i].GetMaxT() * rays[i].GetMaxT());
+					renderData_.samplesAccum[i] += sample;
+
+					if (pass == 0 && renderData_.aovs)
+						renderData_.direct[i] += sample;
 				}
 			}
 		}
 
 		void
-		MonteCarlo::Estimate(const Camera& camera, std::uint32_t frame, const RadeonRays::int2& offset, const RadeonRays::int2& size)
+		MonteCarlo::Estimate(const std::vector<Camera*>& cameras, std::uint32_t frame, const RadeonRays::int2& offset, const RadeonRays::int2& size)
 		{
-			this->GenerateWorkspace(size.x * size.y);
+			// the tiles of all cameras share one workspace, so every trace below covers all of them
+			this->GenerateWorkspace(size.x * size.y * (std::int32_t)cameras.size());
+			this->renderData_.numPixels = size.x * size.y;
+			this->renderData_.aovs = 0;
+
+			for (auto& camera : cameras)
+				this->renderData_.aovs |= camera->getFilm()->getAovMask();
+
+			this->GenerateShapeData();
 			this->GenerateNoise(frame, offset, size);
 
-			this->GenerateCamera(camera, offset, size);
+			this->GenerateCamera(cameras, offset, size);
 
 			for (std::int32_t pass = 0; pass < this->numBounces_; pass++)
 			{
-				api_->QueryIntersection(
-					renderData_.fr_rays,
-					renderData_.numEstimate,
-					renderData_.fr_hits,
-					nullptr,
-					nullptr
-				);
-
-				this->GatherHits();
+				this->GatherHits(pass);
 
 				if (pass == 0)
 					this->GatherFirstSampling();
@@ -535,19 +536,11 @@ namespace octoon
 
 				for (auto& light : RenderScene::instance().getLightList())
 				{
-					if (light->getLayer() != camera.getLayer())
+					auto layer = light->getLayer();
+					if (std::none_of(cameras.begin(), cameras.end(), [layer](const Camera* camera) { return camera->getLayer() == layer; }))
 						continue;
 
-					this->GenerateLightRays(*light);
-
-					api_->QueryIntersection(
-						renderData_.fr_shadowrays,
-						renderData_.numEstimate,
-						renderData_.fr_shadowhits,
-						nullptr,
-						nullptr
-					);
-
+					this->GenerateLightRays(cameras, *light);
 					this->GatherShadowHits();
 					this->GatherLightSamples(pass, *light);
 				}
@@ -557,26 +550,65 @@ namespace octoon
 					this->GenerateRays(pass);
 			}
 
-			this->AccumSampling(frame, offset, size);
+			this->AccumSampling(cameras, offset, size);
 			this->AdaptiveSampling();
 
-			this->ColorTonemapping(frame, offset, size);
+			this->ColorTonemapping(cameras, offset, size);
 		}
 
 		void
-		MonteCarlo::AccumSampling(std::uint32_t frame, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept
+		MonteCarlo::AccumSampling(const std::vector<Camera*>& cameras, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept
 		{
-	#pragma omp parallel for
-			for (std::int32_t i = 0; i < size.x * size.y; ++i)
+			tiles_.resize(cameras.size());
+
+			for (std::size_t c = 0; c < cameras.size(); c++)
 			{
-				auto ix = offset.x + i % size.x;
-				auto iy = offset.y + i / size.x;
-				auto index = iy * this->width_ + ix;
+				auto& film = cameras[c]->getFilm();
+				auto& tile = tiles_[c];
+				tile.reset(offset, size, film->getAovMask());
+
+				auto radiance = tile.getRadiance();
+				auto sampleCount = tile.getSampleCount();
+				auto moment = tile.getMoment();
+				auto first = c * this->renderData_.numPixels;
+				auto samples = renderData_.samplesAccum + first;
+
+	#pragma omp parallel for
+				for (std::int32_t i = 0; i < size.x * size.y; ++i)
+				{
+					auto y = luminance(samples[i]);
+					radiance[i] = samples[i];
+					sampleCount[i] = 1;
+					moment[i] = y * y;
+				}
 
-				auto& hdr = hdr_[index];
-				hdr.x += renderData_.samplesAccum[i].x;
-				hdr.y += renderData_.samplesAccum[i].y;
-				hdr.z += renderData_.samplesAccum[i].z;
+				if (film->getAovMask())
+				{
+					auto depth = tile.getAov(FilmAov::Depth);
+					auto normal = tile.getAov(FilmAov::Normal);
+					auto albedo = tile.getAov(FilmAov::Albedo);
+					auto shapeId = tile.getAov(FilmAov::ShapeId);
+					auto materialId = tile.getAov(FilmAov::MaterialId);
+					auto direct = tile.getAov(FilmAov::Direct);
+					auto indirect = tile.getAov(FilmAov::Indirect);
+					auto count = tile.getAov(FilmAov::SampleCount);
+
+	#pragma omp parallel for
+					for (std::int32_t i = 0; i < size.x * size.y; ++i)
+					{
+						auto sample = first + i;
+						if (depth) depth[i].x = renderData_.depth[sample];
+						if (normal) normal[i] = renderData_.normals[sample];
+						if (albedo) albedo[i] = renderData_.albedo[sample];
+						if (shapeId) shapeId[i].x = (float)renderData_.shapeIds[sample];
+						if (materialId) materialId[i].x = (float)renderData_.materialIds[sample];
+						if (direct) direct[i] = renderData_.direct[sample];
+						if (indirect) indirect[i] = samples[i] - renderData_.direct[sample];
+						if (count) count[i].x = 1.0f;
+					}
+				}
+
+				film->accumulate(tile);
 			}
 		}
 
@@ -586,32 +618,47 @@ namespace octoon
 		}
 
 		void
-		MonteCarlo::ColorTonemapping(std::uint32_t frame, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept
+		MonteCarlo::ColorTonemapping(const std::vector<Camera*>& cameras, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept
 		{
-	#pragma omp parallel for
-			for (std::int32_t i = 0; i < size.x * size.y; ++i)
+			for (std::size_t c = 0; c < cameras.size(); c++)
 			{
-				auto ix = offset.x + i % size.x;
-				auto iy = offset.y + i / size.x;
-				auto index = iy * this->width_ + ix;
+				auto& tile = tiles_[c];
+				auto radiance = tile.getRadiance();
+				auto sampleCount = tile.getSampleCount();
+				auto color = tile.getColor();
+
+	#pragma omp parallel for
+				for (std::int32_t i = 0; i < size.x * size.y; ++i)
+				{
+					auto& hdr = radiance[i];
+					assert(std::isfinite(hdr.x));
+					assert(std::isfinite(hdr.y));
+					assert(std::isfinite(hdr.z));
 
-				auto& hdr = hdr_[index];
-				assert(std::isfinite(hdr.x));
-				assert(std::isfinite(hdr.y));
-				assert(std::isfinite(hdr.z));
+					float scale = 1.0f / std::max<std::uint32_t>(1, sampleCount[i]);
 
-				std::uint8_t r = tonemapping_->map(hdr.x / frame) * 255;
-				std::uint8_t g = tonemapping_->map(hdr.y / frame) * 255;
-				std::uint8_t b = tonemapping_->map(hdr.z / frame) * 255;
+					std::uint8_t r = tonemapping_->map(hdr.x * scale) * 255;
+					std::uint8_t g = tonemapping_->map(hdr.y * scale) * 255;
+					std::uint8_t b = tonemapping_->map(hdr.z * scale) * 255;
 
-				ldr_[index] = 0xFF << 24 | b << 16 | g << 8 | r;
+					color[i] = 0xFF << 24 | b << 16 | g << 8 | r;
+				}
+
+				cameras[c]->getFilm()->resolve(tile);
 			}
 		}
 
 		void
-		MonteCarlo::render(const Camera& camera, std::uint32_t frame, std::uint32_t x, std::uint32_t y, std::uint32_t w, std::uint32_t h) noexcept
+		MonteCarlo::render(const std::vector<Camera*>& cameras, std::uint32_t frame, std::uint32_t x, std::uint32_t y, std::uint32_t w, std::uint32_t h) noexcept
 		{
-			this->Estimate(camera, frame, RadeonRays::int2(x, y), RadeonRays::int2(w, h));
+			if (cameras.empty())
+				return;
+
+			// several pipelines render into the same films at once, so they are sized by System::render, a
+			// film that isn't yet ignores the tiles of this camera
+			assert(std::all_of(cameras.begin(), cameras.end(), [](const Camera* camera) { return camera->getFilm() != nullptr; }));
+
+			this->Estimate(cameras, frame, RadeonRays::int2(x, y), RadeonRays::int2(w, h));
 		}
 	}
 }
\ No newline at end of file
@@ -5,16 +5,18 @@
 #include <vector>
 #include <atomic>
 #include <radeon_rays.h>
-#include <radeon_rays_cl.h>
 #include <memory>
-#include "tiny_obj_loader.h"
 
 #include <octoon/caustic/pipeline.h>
 #include <octoon/caustic/tonemapping.h>
 #include <octoon/caustic/material.h>
+#include <octoon/caustic/mesh.h>
 #include <octoon/caustic/light.h>
 #include <octoon/caustic/camera.h>
 
+#include "intersector.h"
+#include "arena.h"
+
 namespace octoon
 {
 	namespace caustic
@@ -22,82 +24,93 @@ namespace octoon
 		struct RenderData
 		{
 			std::int32_t numEstimate;
-
-			std::vector<RadeonRays::ray> rays[2];
-			std::vector<RadeonRays::Intersection> hits;
-			std::vector<RadeonRays::ray> shadowRays;
-			std::vector<RadeonRays::Intersection> shadowHits;
-			std::vector<RadeonRays::float3> samples;
-			std::vector<RadeonRays::float3> samplesAccum;
-			std::vector<RadeonRays::float2> random;
-			std::vector<RadeonRays::float3> weights;
-
-			RadeonRays::Buffer* fr_rays;
-			RadeonRays::Buffer* fr_shadowrays;
-			RadeonRays::Buffer* fr_shadowhits;
-			RadeonRays::Buffer* fr_hits;
-			RadeonRays::Buffer* fr_hitcount;
+			// pixels of the tile, sample i belongs to camera i / numPixels
+			std::int32_t numPixels;
+
+			// carved from the workspace arena of the pipeline, valid for numEstimate samples
+			RadeonRays::ray* rays[2];
+			RadeonRays::Intersection* hits;
+			RadeonRays::ray* shadowRays;
+			RadeonRays::Intersection* shadowHits;
+			RadeonRays::float3* samples;
+			RadeonRays::float3* samplesAccum;
+			RadeonRays::float2* random;
+			RadeonRays::float2* lens;
+			float* times;
+			RadeonRays::float3* weights;
+
+			// first hit data, only filled while a film of the batch has AOVs (1 << FilmAov) enabled
+			std::uint32_t aovs;
+			float* depth;
+			RadeonRays::float3* normals;
+			RadeonRays::float3* albedo;
+			std::int32_t* shapeIds;
+			std::int32_t* materialIds;
+			RadeonRays::float3* direct;
 		};
 
 		class MonteCarlo : public Pipeline
 		{
 		public:
 			MonteCarlo() noexcept;
-			MonteCarlo(std::uint32_t w, std::uint32_t h) noexcept;
+			MonteCarlo(std::uint32_t w, std::uint32_t h, TraversalBackend backend = kDefaultTraversalBackend) noexcept;
 			~MonteCarlo() noexcept;
 
-			void setup(std::uint32_t w, std::uint32_t h) noexcept(false);
+			void setup(std::uint32_t w, std::uint32_t h, TraversalBackend backend = kDefaultTraversalBackend) noexcept(false);
+
+			// Replaces the backend chosen at setup, e.g. to benchmark another kernel on the same pipeline.
+			void setIntersector(std::unique_ptr<Intersector>&& intersector) noexcept;
+			Intersector* getIntersector() const noexcept;
 
 			const std::uint32_t* data() const noexcept;
 
-			void render(const Camera& camera, std::uint32_t frame, std::uint32_t x, std::uint32_t y, std::uint32_t w, std::uint32_t h) noexcept;
+			void render(const std::vector<Camera*>& cameras, std::uint32_t frame, std::uint32_t x, std::uint32_t y, std::uint32_t w, std::uint32_t h) noexcept;
 
-		private:
-			bool init_data();
-			bool init_Gbuffers(std::uint32_t w, std::uint32_t h) noexcept;
-			bool init_RadeonRays() noexcept;
-			bool init_RadeonRays_Scene();
+			bool getTraversalStats(TraversalStats& stats) const noexcept override;
 
 		private:
 			void GenerateWorkspace(std::int32_t numEstimate);
+			void GenerateShapeData() noexcept;
 
 			void GenerateNoise(std::uint32_t frame, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept;
 			void GenerateRays(std::uint32_t pass) noexcept;
-			void GenerateCamera(const Camera& camera, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept;
-			void GenerateLightRays(const Light& light) noexcept;
+			void GenerateCamera(const std::vector<Camera*>& cameras, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept;
+			void GenerateLightRays(const std::vector<Camera*>& cameras, const Light& light) noexcept;
 
 			void GatherFirstSampling() noexcept;
 			void GatherSampling(std::int32_t pass) noexcept;
-			void GatherHits() noexcept;
+			void GatherHits(std::uint32_t pass) noexcept;
 			void GatherShadowHits() noexcept;
 			void GatherLightSamples(std::uint32_t pass, const Light& light) noexcept;
 
-			void AccumSampling(std::uint32_t frame, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept;
+			void AccumSampling(const std::vector<Camera*>& cameras, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept;
 			void AdaptiveSampling() noexcept;
 
-			void ColorTonemapping(std::uint32_t frame, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept;
+			void ColorTonemapping(const std::vector<Camera*>& cameras, const RadeonRays::int2& offset, const RadeonRays::int2& size) noexcept;
 
-			void Estimate(const Camera& camera, std::uint32_t frame, const RadeonRays::int2& offset, const RadeonRays::int2& size);
+			void Estimate(const std::vector<Camera*>& cameras, std::uint32_t frame, const RadeonRays::int2& offset, const RadeonRays::int2& size);
 
 		private:
 			std::uint32_t width_;
 			std::uint32_t height_;
 
 			std::int32_t numBounces_;
-			std::int32_t tileNums_;
-
-			RadeonRays::IntersectionApi* api_;
 
-			std::vector<std::uint32_t> ldr_;
-			std::vector<RadeonRays::float3> hdr_;
+			std::unique_ptr<Intersector> intersector_;
 
+			Arena workspace_;
 			RenderData renderData_;
 
 			std::unique_ptr<Tonemapping> tonemapping_;
 			std::unique_ptr<class CranleyPatterson> sequences_;
 
-			std::vector<tinyobj::shape_t> scene_;
-			std::vector<Material> materials_;
+			// one per camera of the batch, merged into the camera's film when the tile is done
+			std::vector<FilmTile> tiles_;
+
+			Material defaultMaterial_;
+			std::vector<ShapeData> shapes_;
+			// scene revision shapes_ was built from
+			std::uint32_t shapesRevision_;
 		};
 	}
 }
@@ -0,0 +1,96 @@
+#ifndef OCTOON_CAUSTIC_MPSC_QUEUE_H_
+#define OCTOON_CAUSTIC_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		template<typename T>
+		struct MPSCQueueNode
+		{
+			std::atomic<MPSCQueueNode*> next{ nullptr };
+			T value;
+		};
+
+		// Vyukov's multi-producer single-consumer linked queue over a node pool. The consumer acquires a
+		// node for every value it expects ahead of time and hands it to the producer, so push() neither
+		// allocates nor locks and is wait-free from any thread. pop() and acquire() belong to the consumer,
+		// popped nodes are recycled by acquire(). An element pushed concurrently with pop() may briefly be
+		// invisible, so consumers that sleep need to be woken after the push.
+		template<typename T>
+		class MPSCQueue final
+		{
+		public:
+			using Node = MPSCQueueNode<T>;
+
+			MPSCQueue() noexcept
+				: head_(nullptr)
+				, tail_(nullptr)
+			{
+				tail_ = this->acquire();
+				head_.store(tail_, std::memory_order_relaxed);
+			}
+
+			~MPSCQueue() noexcept
+			{
+			}
+
+			// Only allocates while the pool is smaller than the values in flight.
+			Node* acquire() noexcept(false)
+			{
+				if (free_.empty())
+				{
+					nodes_.push_back(std::make_unique<Node>());
+					return nodes_.back().get();
+				}
+
+				auto node = free_.back();
+				free_.pop_back();
+				node->next.store(nullptr, std::memory_order_relaxed);
+				return node;
+			}
+
+			void push(Node* node, const T& value) noexcept
+			{
+				node->value = value;
+				node->next.store(nullptr, std::memory_order_relaxed);
+
+				auto prev = head_.exchange(node, std::memory_order_acq_rel);
+				prev->next.store(node, std::memory_order_release);
+			}
+
+			bool pop(T& value) noexcept
+			{
+				auto tail = tail_;
+				auto next = tail->next.load(std::memory_order_acquire);
+				if (!next)
+					return false;
+
+				// next becomes the new stub
+				value = next->value;
+				tail_ = next;
+				free_.push_back(tail);
+
+				return true;
+			}
+
+		private:
+			MPSCQueue(const MPSCQueue&) = delete;
+			MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+		private:
+			std::atomic<Node*> head_;
+			Node* tail_;
+
+			// consumer side, owns every node whether queued, handed out or free
+			std::vector<Node*> free_;
+			std::vector<std::unique_ptr<Node>> nodes_;
+		};
+	}
+}
+
+#endif
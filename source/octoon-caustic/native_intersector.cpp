@@ -0,0 +1,164 @@
+#include "native_intersector.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		NativeIntersector::NativeIntersector() noexcept
+			: dirty_(true)
+			, revision_(0)
+		{
+			std::memset(&stats_, 0, sizeof(stats_));
+		}
+
+		NativeIntersector::~NativeIntersector() noexcept
+		{
+		}
+
+		void
+		NativeIntersector::commit(const std::vector<ShapeData>& shapes, std::uint32_t revision) noexcept
+		{
+			if (!dirty_ && revision_ == revision)
+				return;
+
+			for (auto& it : meshes_)
+				it.second.used = false;
+
+			std::vector<BVHInstance> instances;
+
+			float bottomLevelBuildTime = 0.0f;
+
+			for (std::int32_t id = 0; id < (std::int32_t)shapes.size(); id++)
+			{
+				auto& shape = shapes[id];
+				if (!shape.mesh)
+					continue;
+
+				auto& data = meshes_[shape.mesh.get()];
+				if (!data.bvh || data.revision != shape.mesh->revision)
+				{
+					data.mesh = shape.mesh;
+					this->buildMesh(data);
+
+					bottomLevelBuildTime += data.bvh->getStats().buildTime;
+				}
+
+				data.used = true;
+
+				BVHInstance instance;
+				instance.bvh = data.bvh.get();
+				instance.transform = shape.transform;
+				instance.transformInverse = shape.transformInverse;
+				instance.motionTransform = shape.motionTransform;
+				instance.motion = shape.motion;
+				instance.shapeid = id;
+
+				instances.push_back(instance);
+			}
+
+			for (auto it = meshes_.begin(); it != meshes_.end();)
+			{
+				if (!it->second.used)
+					it = meshes_.erase(it);
+				else
+					++it;
+			}
+
+			scene_.build(instances);
+
+			auto& top = scene_.getStats();
+
+			TraversalStats stats;
+			std::memset(&stats, 0, sizeof(stats));
+			stats.numShapes = (std::uint32_t)instances.size();
+			stats.numMeshes = (std::uint32_t)meshes_.size();
+			stats.numTriangles = top.numTriangles;
+			stats.numNodes = top.numNodes;
+			stats.memorySize = top.memorySize;
+			stats.topLevelBuildTime = top.buildTime;
+			stats.bottomLevelBuildTime = bottomLevelBuildTime;
+			stats.sahCost = top.sahCost;
+
+			std::uint32_t bottomDepth = 0;
+			for (auto& it : meshes_)
+			{
+				auto& bottom = it.second.bvh->getStats();
+				stats.numNodes += bottom.numNodes;
+				stats.memorySize += bottom.memorySize;
+				bottomDepth = std::max(bottomDepth, bottom.maxDepth);
+			}
+
+			stats.maxDepth = top.maxDepth + bottomDepth;
+
+			{
+				std::lock_guard<std::mutex> guard(statsLock_);
+				stats_ = stats;
+			}
+
+			dirty_ = false;
+			revision_ = revision;
+		}
+
+		void
+		NativeIntersector::buildMesh(MeshData& data) noexcept
+		{
+			auto& mesh = *data.mesh;
+			auto numTriangles = (std::int32_t)mesh.getNumTriangles();
+
+			std::vector<BVHTriangle> triangles(numTriangles);
+
+	#pragma omp parallel for
+			for (std::int32_t i = 0; i < numTriangles; i++)
+			{
+				auto& tri = triangles[i];
+				tri.v0 = mesh.getPosition(mesh.indices[i * 3]);
+				tri.v1 = mesh.getPosition(mesh.indices[i * 3 + 1]);
+				tri.v2 = mesh.getPosition(mesh.indices[i * 3 + 2]);
+				tri.shapeid = RadeonRays::kNullId;
+				tri.primid = i;
+			}
+
+			// a deformed mesh keeps its topology, an O(n) refit is enough
+			if (data.bvh && data.bvh->getStats().numTriangles == (std::uint32_t)numTriangles)
+			{
+				data.bvh->refit(triangles);
+			}
+			else
+			{
+				data.bvh = std::make_unique<BVH>();
+				data.bvh->build(triangles);
+			}
+
+			data.revision = mesh.revision;
+		}
+
+		void
+		NativeIntersector::intersect(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) noexcept
+		{
+			scene_.intersect(rays, hits, count);
+		}
+
+		void
+		NativeIntersector::occlude(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) noexcept
+		{
+			scene_.occluded(rays, hits, count);
+		}
+
+		bool
+		NativeIntersector::hasMotionBlur() const noexcept
+		{
+			return true;
+		}
+
+		bool
+		NativeIntersector::getStats(TraversalStats& stats) const noexcept
+		{
+			std::lock_guard<std::mutex> guard(statsLock_);
+			stats = stats_;
+			return true;
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef OCTOON_CAUSTIC_NATIVE_INTERSECTOR_H_
+#define OCTOON_CAUSTIC_NATIVE_INTERSECTOR_H_
+
+#include <map>
+#include <mutex>
+
+#include "intersector.h"
+#include "bvh.h"
+
+namespace octoon
+{
+	namespace caustic
+	{
+		// Two level hierarchy, one bottom level BVH per mesh shared by every shape using it
+		// and a top level BVH over the shapes, so moving objects only rebuilds the top level.
+		class NativeIntersector final : public Intersector
+		{
+		public:
+			NativeIntersector() noexcept;
+			~NativeIntersector() noexcept;
+
+			void commit(const std::vector<ShapeData>& shapes, std::uint32_t revision) noexcept override;
+
+			void intersect(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) noexcept override;
+			void occlude(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) noexcept override;
+
+			bool hasMotionBlur() const noexcept override;
+
+			// Safe to call while another thread commits.
+			bool getStats(TraversalStats& stats) const noexcept override;
+
+		private:
+			struct MeshData
+			{
+				// keeps the mesh alive, so its address can't be reused by another mesh while cached
+				std::shared_ptr<const Mesh> mesh;
+				std::unique_ptr<BVH> bvh;
+				std::uint32_t revision;
+				bool used;
+			};
+
+			void buildMesh(MeshData& data) noexcept;
+
+		private:
+			BVH scene_;
+			std::map<const Mesh*, MeshData> meshes_;
+
+			bool dirty_;
+			std::uint32_t revision_;
+
+			mutable std::mutex statsLock_;
+			TraversalStats stats_;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,159 @@
+#include "numa.h"
+
+#if defined(_WIN32)
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#elif defined(__linux__)
+#	include <pthread.h>
+#	include <sched.h>
+#	include <fstream>
+#	include <sstream>
+#	include <string>
+#	include <cstdlib>
+#endif
+
+#include <thread>
+#include <algorithm>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		std::vector<NumaNode> GetAllProcessors() noexcept
+		{
+			NumaNode node;
+			node.id = 0;
+
+			auto count = std::max<std::uint32_t>(1, std::thread::hardware_concurrency());
+			for (std::uint32_t i = 0; i < count; i++)
+				node.cpus.push_back(i);
+
+			return std::vector<NumaNode>(1, node);
+		}
+
+#if defined(_WIN32)
+		std::vector<NumaNode> GetNumaNodes() noexcept
+		{
+			ULONG highest = 0;
+			if (!::GetNumaHighestNodeNumber(&highest))
+				return GetAllProcessors();
+
+			std::vector<NumaNode> nodes;
+
+			for (ULONG i = 0; i <= highest; i++)
+			{
+				GROUP_AFFINITY affinity = {};
+				if (!::GetNumaNodeProcessorMaskEx((USHORT)i, &affinity) || !affinity.Mask)
+					continue;
+
+				// processors are numbered across groups of 64
+				NumaNode node;
+				node.id = i;
+				for (std::uint32_t bit = 0; bit < sizeof(KAFFINITY) * 8; bit++)
+				{
+					if (affinity.Mask & ((KAFFINITY)1 << bit))
+						node.cpus.push_back(affinity.Group * 64 + bit);
+				}
+
+				nodes.push_back(std::move(node));
+			}
+
+			return nodes.empty() ? GetAllProcessors() : nodes;
+		}
+
+		bool PinThread(const std::vector<std::uint32_t>& cpus) noexcept
+		{
+			if (cpus.empty())
+				return false;
+
+			// a thread runs within one processor group, the node's processors share it
+			GROUP_AFFINITY affinity = {};
+			affinity.Group = (WORD)(cpus.front() / 64);
+
+			for (auto cpu : cpus)
+			{
+				if (cpu / 64 == affinity.Group)
+					affinity.Mask |= (KAFFINITY)1 << (cpu % 64);
+			}
+
+			return ::SetThreadGroupAffinity(::GetCurrentThread(), &affinity, nullptr) != 0;
+		}
+#elif defined(__linux__)
+		// "0-3,8-11"
+		std::vector<std::uint32_t> ParseCpuList(const std::string& list) noexcept
+		{
+			std::vector<std::uint32_t> cpus;
+			std::istringstream stream(list);
+			std::string range;
+
+			while (std::getline(stream, range, ','))
+			{
+				if (range.empty() || range[0] < '0' || range[0] > '9')
+					continue;
+
+				char* end = nullptr;
+				auto first = (std::uint32_t)std::strtoul(range.c_str(), &end, 10);
+				auto last = *end == '-' ? (std::uint32_t)std::strtoul(end + 1, nullptr, 10) : first;
+
+				for (auto cpu = first; cpu <= last; cpu++)
+					cpus.push_back(cpu);
+			}
+
+			return cpus;
+		}
+
+		std::vector<NumaNode> GetNumaNodes() noexcept
+		{
+			std::vector<NumaNode> nodes;
+
+			for (std::uint32_t i = 0; ; i++)
+			{
+				std::ifstream stream("/sys/devices/system/node/node" + std::to_string(i) + "/cpulist");
+				if (!stream)
+					break;
+
+				std::string list;
+				std::getline(stream, list);
+
+				NumaNode node;
+				node.id = i;
+				node.cpus = ParseCpuList(list);
+
+				// memory only nodes have no processors to run a group on
+				if (!node.cpus.empty())
+					nodes.push_back(std::move(node));
+			}
+
+			return nodes.empty() ? GetAllProcessors() : nodes;
+		}
+
+		bool PinThread(const std::vector<std::uint32_t>& cpus) noexcept
+		{
+			if (cpus.empty())
+				return false;
+
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			for (auto cpu : cpus)
+			{
+				if (cpu < CPU_SETSIZE)
+					CPU_SET(cpu, &set);
+			}
+
+			return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+		}
+#else
+		std::vector<NumaNode> GetNumaNodes() noexcept
+		{
+			return GetAllProcessors();
+		}
+
+		bool PinThread(const std::vector<std::uint32_t>& cpus) noexcept
+		{
+			return false;
+		}
+#endif
+	}
+}
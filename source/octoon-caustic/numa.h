@@ -0,0 +1,26 @@
+#ifndef OCTOON_CAUSTIC_NUMA_H_
+#define OCTOON_CAUSTIC_NUMA_H_
+
+#include <vector>
+#include <cstdint>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		// Logical processors that share one memory controller.
+		struct NumaNode
+		{
+			std::uint32_t id;
+			std::vector<std::uint32_t> cpus;
+		};
+
+		// Always at least one node, a machine without NUMA reports all processors in node 0.
+		std::vector<NumaNode> GetNumaNodes() noexcept;
+
+		// Restricts the calling thread to the given processors, false where the platform can't.
+		bool PinThread(const std::vector<std::uint32_t>& cpus) noexcept;
+	}
+}
+
+#endif
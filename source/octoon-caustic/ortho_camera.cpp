@@ -1,15 +1,56 @@
 #include <octoon/caustic/ortho_camera.h>
+#include <octoon/caustic/math.h>
 
 namespace octoon
 {
 	namespace caustic
 	{
 		OrthoCamera::OrthoCamera() noexcept
+			: ortho_(-1.0f, 1.0f, -1.0f, 1.0f)
 		{
 		}
 
 		OrthoCamera::~OrthoCamera() noexcept
 		{
 		}
+
+		void
+		OrthoCamera::setOrtho(const RadeonRays::float4& ortho) noexcept
+		{
+			ortho_ = ortho;
+		}
+
+		const RadeonRays::float4&
+		OrthoCamera::getOrtho() const noexcept
+		{
+			return ortho_;
+		}
+
+		void
+		OrthoCamera::generateRays(const RadeonRays::int2& resolution, const RadeonRays::int2& offset, const RadeonRays::int2& size, const RadeonRays::float2* random, const RadeonRays::float2* lens, const float* times, RadeonRays::ray* rays) const noexcept
+		{
+			float xstep = (ortho_.y - ortho_.x) / resolution.x;
+			float ystep = (ortho_.w - ortho_.z) / resolution.y;
+
+			auto transform = this->getTransform();
+			auto motion = this->hasMotion();
+
+	#pragma omp parallel for
+			for (std::int32_t i = 0; i < size.x * size.y; ++i)
+			{
+				auto ix = offset.x + i % size.x;
+				auto iy = offset.y + i / size.x;
+
+				float x = ortho_.x + (ix + random[i].x) * xstep;
+				float y = ortho_.z + (iy + random[i].y) * ystep;
+
+				auto m = motion ? this->getTransform(times[i]) : transform;
+				auto o = TransformPoint(RadeonRays::float3(x, y, 0.0f), m);
+				auto d = RadeonRays::normalize(TransformVector(RadeonRays::float3(0.0f, 0.0f, -1.0f), m));
+
+				rays[i] = RadeonRays::ray(o, d, std::numeric_limits<float>::max(), times[i]);
+				rays[i].SetDoBackfaceCulling(true);
+			}
+		}
 	}
-}
\ No newline at end of file
+}
@@ -11,5 +11,11 @@ namespace octoon
 		Pipeline::~Pipeline() noexcept
 		{
 		}
+
+		bool
+		Pipeline::getTraversalStats(TraversalStats& stats) const noexcept
+		{
+			return false;
+		}
 	}
 }
\ No newline at end of file
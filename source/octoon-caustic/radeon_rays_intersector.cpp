@@ -0,0 +1,106 @@
+#include "radeon_rays_intersector.h"
+#include <cassert>
+#include <cstring>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		RadeonRaysIntersector::RadeonRaysIntersector(RadeonRays::IntersectionApi* api) noexcept
+			: api_(api)
+			, capacity_(0)
+			, raysBuffer_(nullptr)
+			, hitsBuffer_(nullptr)
+			, occlusionBuffer_(nullptr)
+		{
+			assert(api);
+		}
+
+		RadeonRaysIntersector::~RadeonRaysIntersector() noexcept
+		{
+			if (raysBuffer_)
+				api_->DeleteBuffer(raysBuffer_);
+			if (hitsBuffer_)
+				api_->DeleteBuffer(hitsBuffer_);
+			if (occlusionBuffer_)
+				api_->DeleteBuffer(occlusionBuffer_);
+		}
+
+		void
+		RadeonRaysIntersector::commit(const std::vector<ShapeData>&, std::uint32_t) noexcept
+		{
+		}
+
+		void
+		RadeonRaysIntersector::reserve(std::int32_t count) noexcept
+		{
+			if (capacity_ < count)
+			{
+				if (raysBuffer_)
+					api_->DeleteBuffer(raysBuffer_);
+
+				if (hitsBuffer_)
+					api_->DeleteBuffer(hitsBuffer_);
+
+				if (occlusionBuffer_)
+					api_->DeleteBuffer(occlusionBuffer_);
+
+				raysBuffer_ = api_->CreateBuffer(sizeof(RadeonRays::ray) * count, nullptr);
+				hitsBuffer_ = api_->CreateBuffer(sizeof(RadeonRays::Intersection) * count, nullptr);
+				occlusionBuffer_ = api_->CreateBuffer(sizeof(std::int32_t) * count, nullptr);
+
+				capacity_ = count;
+			}
+		}
+
+		void
+		RadeonRaysIntersector::upload(const RadeonRays::ray* rays, std::int32_t count) noexcept
+		{
+			this->reserve(count);
+
+			RadeonRays::ray* data = nullptr;
+			RadeonRays::Event* e = nullptr;
+
+			api_->MapBuffer(raysBuffer_, RadeonRays::kMapWrite, 0, sizeof(RadeonRays::ray) * count, (void**)&data, &e); e->Wait(); api_->DeleteEvent(e);
+			std::memcpy(data, rays, sizeof(RadeonRays::ray) * count);
+			api_->UnmapBuffer(raysBuffer_, data, &e); e->Wait(); api_->DeleteEvent(e);
+		}
+
+		void
+		RadeonRaysIntersector::intersect(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) noexcept
+		{
+			this->upload(rays, count);
+
+			api_->QueryIntersection(raysBuffer_, count, hitsBuffer_, nullptr, nullptr);
+
+			RadeonRays::Intersection* data = nullptr;
+			RadeonRays::Event* e = nullptr;
+
+			api_->MapBuffer(hitsBuffer_, RadeonRays::kMapRead, 0, sizeof(RadeonRays::Intersection) * count, (void**)&data, &e); e->Wait(); api_->DeleteEvent(e);
+			std::memcpy(hits, data, sizeof(RadeonRays::Intersection) * count);
+			api_->UnmapBuffer(hitsBuffer_, data, &e); e->Wait(); api_->DeleteEvent(e);
+		}
+
+		void
+		RadeonRaysIntersector::occlude(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) noexcept
+		{
+			this->upload(rays, count);
+
+			api_->QueryOcclusion(raysBuffer_, count, occlusionBuffer_, nullptr, nullptr);
+
+			std::int32_t* data = nullptr;
+			RadeonRays::Event* e = nullptr;
+
+			api_->MapBuffer(occlusionBuffer_, RadeonRays::kMapRead, 0, sizeof(std::int32_t) * count, (void**)&data, &e); e->Wait(); api_->DeleteEvent(e);
+
+			// the occlusion query only reports kNullId or a hit, not which shape was hit
+			for (std::int32_t i = 0; i < count; ++i)
+			{
+				hits[i].shapeid = data[i];
+				hits[i].primid = RadeonRays::kNullId;
+			}
+
+			api_->UnmapBuffer(occlusionBuffer_, data, &e); e->Wait(); api_->DeleteEvent(e);
+		}
+	}
+}
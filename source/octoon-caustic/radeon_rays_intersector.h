@@ -0,0 +1,39 @@
+#ifndef OCTOON_CAUSTIC_RADEON_RAYS_INTERSECTOR_H_
+#define OCTOON_CAUSTIC_RADEON_RAYS_INTERSECTOR_H_
+
+#include "intersector.h"
+
+namespace octoon
+{
+	namespace caustic
+	{
+		// Streams the rays through device buffers of the RenderScene IntersectionApi,
+		// the scene itself is committed by RenderScene.
+		class RadeonRaysIntersector final : public Intersector
+		{
+		public:
+			RadeonRaysIntersector(RadeonRays::IntersectionApi* api) noexcept;
+			~RadeonRaysIntersector() noexcept;
+
+			void commit(const std::vector<ShapeData>& shapes, std::uint32_t revision) noexcept override;
+
+			void intersect(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) noexcept override;
+			void occlude(const RadeonRays::ray* rays, RadeonRays::Intersection* hits, std::int32_t count) noexcept override;
+
+		private:
+			void reserve(std::int32_t count) noexcept;
+			void upload(const RadeonRays::ray* rays, std::int32_t count) noexcept;
+
+		private:
+			RadeonRays::IntersectionApi* api_;
+
+			std::int32_t capacity_;
+
+			RadeonRays::Buffer* raysBuffer_;
+			RadeonRays::Buffer* hitsBuffer_;
+			RadeonRays::Buffer* occlusionBuffer_;
+		};
+	}
+}
+
+#endif
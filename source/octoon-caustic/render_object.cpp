@@ -1,5 +1,6 @@
 #include <octoon/caustic/render_object.h>
 #include <octoon/caustic/render_scene.h>
+#include <octoon/caustic/math.h>
 
 namespace octoon
 {
@@ -8,6 +9,7 @@ namespace octoon
 		RenderObject::RenderObject() noexcept
 			: active_(false)
 			, visible_(true)
+			, motion_(false)
 			, layer_(0)
 		{
 		}
@@ -65,6 +67,11 @@ namespace octoon
 		{
 			transform_ = m;
 			transformInverse_ = minv;
+			motionTransform_ = m;
+			motionTransformInverse_ = minv;
+			motion_ = false;
+
+			this->onMoveAfter();
 		}
 
 		const RadeonRays::matrix&
@@ -79,6 +86,40 @@ namespace octoon
 			return transformInverse_;
 		}
 
+		void
+		RenderObject::setMotionTransform(const RadeonRays::matrix& m, const RadeonRays::matrix& minv) noexcept
+		{
+			motionTransform_ = m;
+			motionTransformInverse_ = minv;
+			motion_ = true;
+
+			this->onMoveAfter();
+		}
+
+		const RadeonRays::matrix&
+		RenderObject::getMotionTransform() const noexcept
+		{
+			return motionTransform_;
+		}
+
+		const RadeonRays::matrix&
+		RenderObject::getMotionTransformInverse() const noexcept
+		{
+			return motionTransformInverse_;
+		}
+
+		bool
+		RenderObject::hasMotion() const noexcept
+		{
+			return motion_;
+		}
+
+		RadeonRays::matrix
+		RenderObject::getTransform(float time) const noexcept
+		{
+			return motion_ ? InterpolateTransform(transform_, motionTransform_, time) : transform_;
+		}
+
 		RadeonRays::float3
 		RenderObject::getTranslate() const noexcept
 		{
@@ -96,5 +137,10 @@ namespace octoon
 		{
 			RenderScene::instance().removeRenderObject(this);
 		}
+
+		void
+		RenderObject::onMoveAfter() noexcept
+		{
+		}
 	}
 }
\ No newline at end of file
@@ -7,6 +7,10 @@ namespace octoon
 	{
 		RenderScene::RenderScene() noexcept
 			: api_(nullptr)
+			, dirty_(false)
+			, updateCount_(0)
+			, revision_(0)
+			, shapeCount_(0)
 		{
 		}
 
@@ -25,7 +29,9 @@ namespace octoon
 		bool
 		RenderScene::setup() noexcept
 		{
-			assert(this->api_ == nullptr);
+#if defined(OCTOON_BUILD_RADEON_RAYS)
+			if (this->api_)
+				return true;
 
 			RadeonRays::IntersectionApi::SetPlatform(RadeonRays::DeviceInfo::kAny);
 
@@ -64,16 +70,22 @@ namespace octoon
 
 			this->api_ = RadeonRays::IntersectionApi::Create(deviceidx);
 			return this->api_ != nullptr;
+#else
+			return false;
+#endif
 		}
 
 		void 
 		RenderScene::close() noexcept
 		{
+#if defined(OCTOON_BUILD_RADEON_RAYS)
 			if (this->api_)
 			{
 				this->api_->DetachAll();
 				RadeonRays::IntersectionApi::Delete(this->api_);
+				this->api_ = nullptr;
 			}
+#endif
 		}
 
 		void
@@ -81,6 +93,7 @@ namespace octoon
 		{
 			assert(camera);
 
+			std::lock_guard<std::mutex> guard(lock_);
 			auto it = std::find(cameras_.begin(), cameras_.end(), camera);
 			if (it == cameras_.end())
 				cameras_.push_back(camera);
@@ -91,6 +104,7 @@ namespace octoon
 		{
 			assert(camera);
 
+			std::lock_guard<std::mutex> guard(lock_);
 			auto it = std::find(cameras_.begin(), cameras_.end(), camera);
 			if (it != cameras_.end())
 				cameras_.erase(it);
@@ -107,6 +121,7 @@ namespace octoon
 		{
 			assert(light);
 
+			std::lock_guard<std::mutex> guard(lock_);
 			auto it = std::find(lights_.begin(), lights_.end(), light);
 			if (it == lights_.end())
 				lights_.push_back(light);
@@ -117,6 +132,7 @@ namespace octoon
 		{
 			assert(light);
 
+			std::lock_guard<std::mutex> guard(lock_);
 			auto it = std::find(lights_.begin(), lights_.end(), light);
 			if (it != lights_.end())
 				lights_.erase(it);
@@ -138,7 +154,10 @@ namespace octoon
 			else if (object->isA<Light>())
 				this->addLight(object->downcast<Light>());
 			else
+			{
+				std::lock_guard<std::mutex> guard(lock_);
 				renderables_.push_back(object);
+			}
 		}
 
 		void
@@ -147,19 +166,12 @@ namespace octoon
 			assert(object);
 
 			if (object->isA<Camera>())
-			{
-				auto it = std::find(cameras_.begin(), cameras_.end(), object->downcast<Camera>());
-				if (it != cameras_.end())
-					cameras_.erase(it);
-			}
+				this->removeCamera(object->downcast<Camera>());
 			else if (object->isA<Light>())
-			{
-				auto it = std::find(lights_.begin(), lights_.end(), object->downcast<Light>());
-				if (it != lights_.end())
-					lights_.erase(it);
-			}
+				this->removeLight(object->downcast<Light>());
 			else
 			{
+				std::lock_guard<std::mutex> guard(lock_);
 				auto it = std::find(renderables_.begin(), renderables_.end(), object);
 				if (it != renderables_.end())
 					renderables_.erase(it);
@@ -172,10 +184,150 @@ namespace octoon
 			return renderables_;
 		}
 
+		std::int32_t
+		RenderScene::getShapeCount() const noexcept
+		{
+			return shapeCount_;
+		}
+
+		std::uint32_t
+		RenderScene::getRevision() const noexcept
+		{
+			return revision_;
+		}
+
+		void
+		RenderScene::beginUpdate() noexcept
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			updateCount_++;
+		}
+
+		void
+		RenderScene::endUpdate() noexcept
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			assert(updateCount_ > 0);
+
+			if (--updateCount_ == 0 && dirty_)
+			{
+				if (this->api_)
+					this->api_->Commit();
+
+				dirty_ = false;
+				revision_++;
+			}
+		}
+
 		RadeonRays::IntersectionApi* 
 		RenderScene::getIntersectionApi() const noexcept
 		{
 			return this->api_;
 		}
+
+		RadeonRays::Shape*
+		RenderScene::createMesh(const float* vertices, int vnum, int vstride, const int* indices, int istride, const int* numfacevertices, int numfaces, std::int32_t id) noexcept
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			if (!this->api_)
+				return nullptr;
+
+			auto shape = this->api_->CreateMesh(vertices, vnum, vstride, indices, istride, numfacevertices, numfaces);
+			if (shape)
+				shape->SetId(id);
+
+			return shape;
+		}
+
+		RadeonRays::Shape*
+		RenderScene::createInstance(const RadeonRays::Shape* shape, std::int32_t id) noexcept
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			if (!this->api_)
+				return nullptr;
+
+			auto instance = this->api_->CreateInstance(shape);
+			if (instance)
+				instance->SetId(id);
+
+			return instance;
+		}
+
+		void
+		RenderScene::deleteShape(const RadeonRays::Shape* shape) noexcept
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			if (this->api_ && shape)
+				this->api_->DeleteShape(shape);
+		}
+
+		std::int32_t
+		RenderScene::allocShapeId() noexcept
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			if (freeShapeIds_.empty())
+				return shapeCount_++;
+
+			auto id = freeShapeIds_.back();
+			freeShapeIds_.pop_back();
+			return id;
+		}
+
+		void
+		RenderScene::freeShapeId(std::int32_t id) noexcept
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			freeShapeIds_.push_back(id);
+		}
+
+		// Without a RadeonRays device the shape handles are null, the scene then only tracks changes for the pipeline.
+		void
+		RenderScene::attachShape(const RadeonRays::Shape* shape) noexcept
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			if (this->api_ && shape)
+				this->api_->AttachShape(shape);
+			dirty_ = true;
+		}
+
+		void
+		RenderScene::detachShape(const RadeonRays::Shape* shape) noexcept
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			if (this->api_ && shape)
+				this->api_->DetachShape(shape);
+			dirty_ = true;
+		}
+
+		void
+		RenderScene::setShapeTransform(RadeonRays::Shape* shape, const RadeonRays::matrix& m, const RadeonRays::matrix& minv) noexcept
+		{
+			// RadeonRays transforms column vectors, while our matrices keep the translation in the last row.
+			std::lock_guard<std::mutex> guard(lock_);
+			if (shape)
+				shape->SetTransform(m.transpose(), minv.transpose());
+			dirty_ = true;
+		}
+
+		void
+		RenderScene::commit() noexcept
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			if (updateCount_ == 0 && dirty_)
+			{
+				if (this->api_)
+					this->api_->Commit();
+
+				dirty_ = false;
+				revision_++;
+			}
+		}
+
+		void
+		RenderScene::touch() noexcept
+		{
+			std::lock_guard<std::mutex> guard(lock_);
+			revision_++;
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "socket.h"
+
+#if defined(_WIN32)
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <winsock2.h>
+#	include <ws2tcpip.h>
+#else
+#	include <sys/socket.h>
+#	include <netinet/in.h>
+#	include <netinet/tcp.h>
+#	include <netdb.h>
+#	include <unistd.h>
+#	include <sys/time.h>
+#endif
+
+#include <cstring>
+#include <algorithm>
+
+namespace octoon
+{
+	namespace caustic
+	{
+#if defined(_WIN32)
+		constexpr std::intptr_t kInvalidSocket = (std::intptr_t)INVALID_SOCKET;
+
+		bool InitSockets() noexcept
+		{
+			static bool init = []()
+			{
+				WSADATA data;
+				return ::WSAStartup(MAKEWORD(2, 2), &data) == 0;
+			}();
+
+			return init;
+		}
+
+		void CloseSocket(std::intptr_t handle) noexcept
+		{
+			::closesocket((SOCKET)handle);
+		}
+
+		constexpr int kShutdownBoth = SD_BOTH;
+		constexpr int kSendFlags = 0;
+#else
+		constexpr std::intptr_t kInvalidSocket = -1;
+
+		bool InitSockets() noexcept
+		{
+			return true;
+		}
+
+		void CloseSocket(std::intptr_t handle) noexcept
+		{
+			::close((int)handle);
+		}
+
+		constexpr int kShutdownBoth = SHUT_RDWR;
+		// a worker that went away must fail the send, not raise SIGPIPE
+#	if defined(MSG_NOSIGNAL)
+		constexpr int kSendFlags = MSG_NOSIGNAL;
+#	else
+		constexpr int kSendFlags = 0;
+#	endif
+#endif
+
+		Socket::Socket() noexcept
+			: handle_(kInvalidSocket)
+		{
+		}
+
+		Socket::Socket(Socket&& other) noexcept
+			: handle_(other.handle_)
+		{
+			other.handle_ = kInvalidSocket;
+		}
+
+		Socket::~Socket() noexcept
+		{
+			this->close();
+		}
+
+		Socket&
+		Socket::operator=(Socket&& other) noexcept
+		{
+			if (this != &other)
+			{
+				this->close();
+				handle_ = other.handle_;
+				other.handle_ = kInvalidSocket;
+			}
+
+			return *this;
+		}
+
+		bool
+		Socket::connect(const std::string& host, std::uint16_t port) noexcept
+		{
+			if (!InitSockets())
+				return false;
+
+			this->close();
+
+			addrinfo hints;
+			std::memset(&hints, 0, sizeof(hints));
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+			hints.ai_protocol = IPPROTO_TCP;
+
+			addrinfo* result = nullptr;
+			if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0)
+				return false;
+
+			for (auto it = result; it; it = it->ai_next)
+			{
+				auto handle = (std::intptr_t)::socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+				if (handle == kInvalidSocket)
+					continue;
+
+				if (::connect(handle, it->ai_addr, (int)it->ai_addrlen) == 0)
+				{
+					handle_ = handle;
+					break;
+				}
+
+				CloseSocket(handle);
+			}
+
+			::freeaddrinfo(result);
+
+			if (handle_ == kInvalidSocket)
+				return false;
+
+			// tiles go out as soon as they are written
+			int nodelay = 1;
+			::setsockopt(handle_, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+
+			return true;
+		}
+
+		bool
+		Socket::listen(std::uint16_t port) noexcept
+		{
+			if (!InitSockets())
+				return false;
+
+			this->close();
+
+			auto handle = (std::intptr_t)::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			if (handle == kInvalidSocket)
+				return false;
+
+			int reuse = 1;
+			::setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+			sockaddr_in address;
+			std::memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_ANY);
+			address.sin_port = htons(port);
+
+			if (::bind(handle, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(handle, SOMAXCONN) != 0)
+			{
+				CloseSocket(handle);
+				return false;
+			}
+
+			handle_ = handle;
+			return true;
+		}
+
+		Socket
+		Socket::accept() noexcept
+		{
+			Socket socket;
+			if (handle_ == kInvalidSocket)
+				return socket;
+
+			auto handle = (std::intptr_t)::accept(handle_, nullptr, nullptr);
+			if (handle == kInvalidSocket)
+				return socket;
+
+			int nodelay = 1;
+			::setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+
+			socket.handle_ = handle;
+			return socket;
+		}
+
+		bool
+		Socket::send(const void* data, std::size_t size) noexcept
+		{
+			auto bytes = (const char*)data;
+
+			while (size > 0)
+			{
+				auto count = ::send(handle_, bytes, (int)std::min<std::size_t>(size, 1 << 30), kSendFlags);
+				if (count <= 0)
+					return false;
+
+				bytes += count;
+				size -= count;
+			}
+
+			return true;
+		}
+
+		bool
+		Socket::recv(void* data, std::size_t size) noexcept
+		{
+			auto bytes = (char*)data;
+
+			while (size > 0)
+			{
+				auto count = ::recv(handle_, bytes, (int)std::min<std::size_t>(size, 1 << 30), 0);
+				if (count <= 0)
+					return false;
+
+				bytes += count;
+				size -= count;
+			}
+
+			return true;
+		}
+
+		bool
+		Socket::setTimeout(std::uint32_t milliseconds) noexcept
+		{
+#if defined(_WIN32)
+			DWORD timeout = milliseconds;
+#else
+			timeval timeout;
+			timeout.tv_sec = milliseconds / 1000;
+			timeout.tv_usec = (milliseconds % 1000) * 1000;
+#endif
+			return
+				::setsockopt(handle_, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout)) == 0 &&
+				::setsockopt(handle_, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout)) == 0;
+		}
+
+		bool
+		Socket::setKeepAlive(bool enable) noexcept
+		{
+			int keepalive = enable ? 1 : 0;
+			return ::setsockopt(handle_, SOL_SOCKET, SO_KEEPALIVE, (const char*)&keepalive, sizeof(keepalive)) == 0;
+		}
+
+		void
+		Socket::shutdown() noexcept
+		{
+			if (handle_ != kInvalidSocket)
+				::shutdown(handle_, kShutdownBoth);
+		}
+
+		void
+		Socket::close() noexcept
+		{
+			if (handle_ != kInvalidSocket)
+			{
+				CloseSocket(handle_);
+				handle_ = kInvalidSocket;
+			}
+		}
+
+		bool
+		Socket::valid() const noexcept
+		{
+			return handle_ != kInvalidSocket;
+		}
+	}
+}
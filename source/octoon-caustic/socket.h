@@ -0,0 +1,51 @@
+#ifndef OCTOON_CAUSTIC_SOCKET_H_
+#define OCTOON_CAUSTIC_SOCKET_H_
+
+#include <string>
+#include <cstdint>
+
+namespace octoon
+{
+	namespace caustic
+	{
+		// Blocking TCP stream over winsock or BSD sockets, just enough for the coordinator and its workers.
+		class Socket final
+		{
+		public:
+			Socket() noexcept;
+			Socket(Socket&& other) noexcept;
+			~Socket() noexcept;
+
+			Socket& operator=(Socket&& other) noexcept;
+
+			bool connect(const std::string& host, std::uint16_t port) noexcept;
+			bool listen(std::uint16_t port) noexcept;
+			// Invalid once the listening socket was closed.
+			Socket accept() noexcept;
+
+			// Both transfer the full size or fail.
+			bool send(const void* data, std::size_t size) noexcept;
+			bool recv(void* data, std::size_t size) noexcept;
+
+			// A send or recv blocked for longer fails instead of waiting forever, zero waits forever.
+			bool setTimeout(std::uint32_t milliseconds) noexcept;
+			// Probes an idle connection, so a peer that vanished without closing it is noticed.
+			bool setKeepAlive(bool enable) noexcept;
+
+			// Unblocks a send, recv or accept waiting on another thread.
+			void shutdown() noexcept;
+			void close() noexcept;
+
+			bool valid() const noexcept;
+
+		private:
+			Socket(const Socket&) = delete;
+			Socket& operator=(const Socket&) = delete;
+
+		private:
+			std::intptr_t handle_;
+		};
+	}
+}
+
+#endif
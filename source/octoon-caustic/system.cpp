@@ -2,16 +2,165 @@
 #include <octoon/caustic/film_camera.h>
 #include <octoon/caustic/point_light.h>
 #include <octoon/caustic/sphere_light.h>
+#include <octoon/caustic/math.h>
+#include <octoon/caustic/ACES.h>
 #include "montecarlo.h"
+#include "mesh_optimizer.h"
+#include "mpsc_queue.h"
+#include "socket.h"
+#include "numa.h"
+#include "tiny_obj_loader.h"
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+#if defined(_WIN32)
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+#	include <omp.h>
+#endif
 
 namespace octoon
 {
 	namespace caustic
 	{
+		constexpr std::uint32_t kCheckpointMagic = 0x54504B43; // "CKPT"
+		constexpr std::uint32_t kCheckpointVersion = 2;
+
+		// both ends of a cluster connection must run on the same byte order
+		constexpr std::uint32_t kClusterMagic = 0x4E54434F; // "OCTN"
+		constexpr std::uint32_t kClusterVersion = 1;
+
+		// limits a render node accepts from the coordinator before sizing anything by them
+		constexpr std::uint32_t kClusterMaxTileSize = 16384;
+		constexpr std::uint32_t kClusterMaxSamplesPerTile = 4096;
+
+		// distance along a Hilbert curve covering n x n cells, n a power of two
+		std::uint32_t HilbertIndex(std::uint32_t n, std::uint32_t x, std::uint32_t y) noexcept
+		{
+			std::uint32_t d = 0;
+
+			for (std::uint32_t s = n / 2; s > 0; s /= 2)
+			{
+				std::uint32_t rx = (x & s) ? 1 : 0;
+				std::uint32_t ry = (y & s) ? 1 : 0;
+				d += s * s * ((3 * rx) ^ ry);
+
+				if (ry == 0)
+				{
+					if (rx == 1)
+					{
+						x = n - 1 - x;
+						y = n - 1 - y;
+					}
+
+					std::swap(x, y);
+				}
+			}
+
+			return d;
+		}
+
+		std::uint32_t MortonIndex(std::uint32_t x, std::uint32_t y) noexcept
+		{
+			std::uint32_t d = 0;
+			for (std::uint32_t i = 0; i < 16; i++)
+				d |= ((x >> i) & 1) << (2 * i) | ((y >> i) & 1) << (2 * i + 1);
+			return d;
+		}
+
+#if defined(_WIN32)
+		// narrow paths are in the ANSI code page, as std::ofstream takes them
+		std::wstring Widen(const std::string& path) noexcept
+		{
+			std::wstring wide(::MultiByteToWideChar(CP_ACP, 0, path.c_str(), -1, nullptr, 0), L'\0');
+			if (!wide.empty())
+				::MultiByteToWideChar(CP_ACP, 0, path.c_str(), -1, &wide[0], (int)wide.size());
+			return wide;
+		}
+#endif
+
+		// Forces the written file to disk, a rename may otherwise reach the disk before the data does
+		// and a crash leaves an empty or truncated file behind the new name.
+		bool SyncFile(const std::string& path) noexcept
+		{
+#if defined(_WIN32)
+			auto file = ::CreateFileW(Widen(path).c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				return false;
+
+			auto flushed = ::FlushFileBuffers(file) != 0;
+			::CloseHandle(file);
+			return flushed;
+#else
+			auto fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				return false;
+
+			auto synced = ::fsync(fd) == 0;
+			::close(fd);
+			return synced;
+#endif
+		}
+
+		bool RenameOver(const std::string& from, const std::string& to) noexcept
+		{
+#if defined(_WIN32)
+			return ::MoveFileExW(Widen(from).c_str(), Widen(to).c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+			// replaces the target atomically, there is always a complete file at the path
+			if (std::rename(from.c_str(), to.c_str()) != 0)
+				return false;
+
+			// the rename itself lives in the directory, sync it too so it survives a power loss
+			auto slash = to.find_last_of('/');
+			auto dir = slash == std::string::npos ? std::string(".") : (slash == 0 ? std::string("/") : to.substr(0, slash));
+
+			auto fd = ::open(dir.c_str(), O_RDONLY);
+			if (fd >= 0)
+			{
+				::fsync(fd);
+				::close(fd);
+			}
+
+			return true;
+#endif
+		}
+
 		System::System() noexcept
 			: isQuitRequest_(false)
+			, groupCount_(1)
+			, threadPinning_(false)
+			, backend_(kDefaultTraversalBackend)
 			, tileWidth_(512)
 			, tileHeight_(512)
+			, tileOrder_(TileOrder::RowMajor)
+			, tilesX_(0)
+			, tilesY_(0)
+			, frame_(0)
+			, framesInFlight_(1)
+			, checkpointInterval_(0)
+			, denoise_(false)
+			, denoiseInterval_(8)
+			, denoiseFrames_(0)
+			, tonemapping_(std::make_unique<ACES>())
+			, previewInterval_(16)
+			, pending_(0)
+			, completions_(std::make_unique<MPSCQueue<TileCompletion>>())
+			, samplesPerTile_(1)
+			, workerCount_(0)
+			, workerTimeout_(60000)
+			, listening_(false)
 		{
 		}
 
@@ -32,18 +181,48 @@ namespace octoon
 		System::~System()
 		{
 			isQuitRequest_ = true;
-			thread_.join();
+			this->stopGroups();
+
+			if (listener_)
+			{
+				listener_->shutdown();
+				listener_->close();
+				acceptThread_.join();
+
+				{
+					std::lock_guard<std::mutex> guard(itemsLock_);
+					for (auto& socket : sockets_)
+						socket->shutdown();
+					itemsSignal_.notify_all();
+				}
+
+				for (auto& connection : connections_)
+					connection.join();
+			}
 		}
 
 		void
-		System::setup(std::uint32_t w, std::uint32_t h) noexcept(false)
+		System::setup(std::uint32_t w, std::uint32_t h, TraversalBackend backend) noexcept(false)
 		{
 			width_ = w;
 			height_ = h;
+			backend_ = backend;
+
+			if (backend_ == TraversalBackend::RadeonRays)
+			{
+				if (!RenderScene::instance().setup())
+					throw std::runtime_error("RenderScene::setup() fail");
+			}
+
+			this->loadObj("../Resources/CornellBox/orig.objm", "../Resources/CornellBox/");
 
 			RadeonRays::matrix transform(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0.f, 1.f, 3.f, 1);
 
 			static auto camera = std::make_shared<FilmCamera>();
+			camera->setFov(53.13f);
+			camera->getFilm()->setAovEnable(FilmAov::Depth, true);
+			camera->getFilm()->setAovEnable(FilmAov::Normal, true);
+			camera->getFilm()->setAovEnable(FilmAov::Albedo, true);
 			camera->setTransform(transform, transform);
 			camera->setActive(true);
 
@@ -52,7 +231,140 @@ namespace octoon
 			sphereLight->setTemperature(6000);
 			sphereLight->setActive(true);
 
- 			thread_ = std::thread(std::bind(&System::thread, this));
+			// the films are allocated untouched, each group clears the rows it renders
+			for (auto& it : RenderScene::instance().getCameraList())
+			{
+				if (!it->getFilm())
+					it->setFilm(std::make_shared<Film>());
+				it->getFilm()->resize(width_, height_, false);
+			}
+
+			this->startGroups(true);
+		}
+
+		void
+		System::setWorkerGroups(std::uint32_t count) noexcept
+		{
+			groupCount_ = count;
+
+			if (!groups_.empty())
+			{
+				this->stopGroups();
+				this->startGroups(false);
+			}
+		}
+
+		std::uint32_t
+		System::getWorkerGroups() const noexcept
+		{
+			return groupCount_;
+		}
+
+		void
+		System::setThreadPinning(bool enable) noexcept
+		{
+			threadPinning_ = enable;
+
+			if (!groups_.empty())
+			{
+				this->stopGroups();
+				this->startGroups(false);
+			}
+		}
+
+		bool
+		System::getThreadPinning() const noexcept
+		{
+			return threadPinning_;
+		}
+
+		bool
+		System::getTraversalStats(TraversalStats& stats) const noexcept
+		{
+			if (groups_.empty() || !groups_.front()->pipeline)
+				return false;
+
+			return groups_.front()->pipeline->getTraversalStats(stats);
+		}
+
+		void
+		System::startGroups(bool firstTouch) noexcept
+		{
+			auto nodes = GetNumaNodes();
+			auto count = groupCount_ ? groupCount_ : (std::uint32_t)nodes.size();
+
+			// every RadeonRaysIntersector maps and queries the one IntersectionApi of the scene, which isn't
+			// safe to call from several threads, and the device is shared anyway
+			if (backend_ == TraversalBackend::RadeonRays)
+				count = 1;
+
+			for (std::uint32_t i = 0; i < count; i++)
+			{
+				auto group = std::make_unique<WorkerGroup>();
+				group->quit = false;
+
+				if (count <= nodes.size())
+				{
+					// fewer groups than nodes, each takes a run of whole nodes
+					for (std::size_t n = 0; n < nodes.size(); n++)
+					{
+						if (n * count / nodes.size() == i)
+							group->cpus.insert(group->cpus.end(), nodes[n].cpus.begin(), nodes[n].cpus.end());
+					}
+				}
+				else
+				{
+					// more groups than nodes, the groups of a node split its processors
+					auto& node = nodes[i % nodes.size()];
+					auto shared = (count - i % nodes.size() + nodes.size() - 1) / nodes.size();
+					auto slot = i / nodes.size();
+					auto first = node.cpus.size() * slot / shared;
+					auto last = std::max(first + 1, node.cpus.size() * (slot + 1) / shared);
+
+					group->cpus.assign(node.cpus.begin() + std::min(first, node.cpus.size() - 1), node.cpus.begin() + std::min(last, node.cpus.size()));
+				}
+
+				groups_.push_back(std::move(group));
+			}
+
+			// the pipelines are created on their threads, wait until all are ready
+			std::vector<std::promise<void>> ready(groups_.size());
+
+			for (std::uint32_t i = 0; i < groups_.size(); i++)
+				groups_[i]->thread = std::thread(&System::thread, this, std::ref(*groups_[i]), i, firstTouch, std::ref(ready[i]));
+
+			for (auto& it : ready)
+				it.get_future().wait();
+		}
+
+		void
+		System::stopGroups() noexcept
+		{
+			for (auto& group : groups_)
+			{
+				std::lock_guard<std::mutex> guard(group->lock);
+				group->quit = true;
+				group->signal.notify_one();
+			}
+
+			{
+				std::lock_guard<std::mutex> guard(itemsLock_);
+				itemsSignal_.notify_all();
+			}
+
+			for (auto& group : groups_)
+				group->thread.join();
+
+			groups_.clear();
+		}
+
+		System::WorkerGroup&
+		System::getTileGroup(std::uint32_t tile) const noexcept
+		{
+			// by the center row, so the bands match the rows each group first touched
+			auto rect = this->getTileRect(tile);
+			auto index = (rect.y + rect.h / 2) * groups_.size() / height_;
+			return *groups_[std::min<std::size_t>(index, groups_.size() - 1)];
 		}
 
 		void
@@ -79,58 +391,250 @@ namespace octoon
 			return tileHeight_;
 		}
 
-		std::future<std::uint32_t>
-		System::renderTile(std::uint32_t frame, std::uint32_t tile) noexcept
+		void
+		System::setTileSizeAuto() noexcept
 		{
-			auto w = (width_ + tileWidth_ - 1) / tileWidth_;
-			auto x = tile % w * tileWidth_;
-			auto y = tile / w * tileHeight_;
+			// a few thousand samples per core keep the parallel loops of a wavefront busy
+			auto cores = std::max<std::uint32_t>(1, std::thread::hardware_concurrency());
+			auto pixels = clamp(cores * 4096, 64 * 64, 512 * 512);
+			auto size = (std::uint32_t)std::ceil(std::sqrt((float)pixels) / 16) * 16;
+
+			// while at least 16 tiles per frame leave the preview something to show in between
+			while (size > 64 && ((width_ + size - 1) / size) * ((height_ + size - 1) / size) < 16)
+				size = std::max<std::uint32_t>(64, (size / 2 + 15) / 16 * 16);
+
+			this->setTileWidth(size);
+			this->setTileHeight(size);
+		}
+
+		void
+		System::setTileOrder(TileOrder order) noexcept
+		{
+			tileOrder_ = order;
+			tiles_.clear();
+		}
+
+		TileOrder
+		System::getTileOrder() const noexcept
+		{
+			return tileOrder_;
+		}
+
+		void
+		System::buildTileOrder(std::uint32_t w, std::uint32_t h) noexcept
+		{
+			tilesX_ = w;
+			tilesY_ = h;
+
+			tiles_.resize(w * h);
+			for (std::uint32_t i = 0; i < w * h; i++)
+				tiles_[i] = i;
 
-			std::packaged_task<std::uint32_t()> task([=]()
+			std::vector<double> keys(w * h);
+
+			switch (tileOrder_)
 			{
-				auto& cameras = RenderScene::instance().getCameraList();
-				for (auto& camera : cameras)
+			case TileOrder::RowMajor:
+				return;
+			case TileOrder::Morton:
+				for (std::uint32_t i = 0; i < w * h; i++)
+					keys[i] = MortonIndex(i % w, i / w);
+				break;
+			case TileOrder::Hilbert:
+			{
+				std::uint32_t n = 1;
+				while (n < std::max(w, h))
+					n *= 2;
+
+				for (std::uint32_t i = 0; i < w * h; i++)
+					keys[i] = HilbertIndex(n, i % w, i / w);
+				break;
+			}
+			case TileOrder::Spiral:
+				// ring by ring around the center, each ring in angle order
+				for (std::uint32_t i = 0; i < w * h; i++)
+				{
+					float dx = (i % w) + 0.5f - w * 0.5f;
+					float dy = (i / w) + 0.5f - h * 0.5f;
+					float ring = std::floor(std::max(std::abs(dx), std::abs(dy)));
+					keys[i] = ring * 8.0f + (std::atan2(dy, dx) + PI) / PI;
+				}
+				break;
+			}
+
+			std::stable_sort(tiles_.begin(), tiles_.end(), [&](std::uint32_t a, std::uint32_t b) { return keys[a] < keys[b]; });
+		}
+
+		void
+		System::loadObj(const std::string& filename, const std::string& basepath) noexcept(false)
+		{
+			std::vector<tinyobj::shape_t> shapes;
+			std::vector<tinyobj::material_t> materials;
+
+			std::string res = tinyobj::LoadObj(shapes, materials, filename.c_str(), basepath.c_str());
+			if (!res.empty())
+				throw std::runtime_error(res);
+
+			std::vector<std::shared_ptr<Material>> mats;
+
+			for (auto& it : materials)
+			{
+				auto m = std::make_shared<Material>();
+				m->albedo.x = std::pow(it.diffuse[0], 2.2f);
+				m->albedo.y = std::pow(it.diffuse[1], 2.2f);
+				m->albedo.z = std::pow(it.diffuse[2], 2.2f);
+
+				m->specular.x = std::pow(it.specular[0], 2.2f) * 0.04f;
+				m->specular.y = std::pow(it.specular[1], 2.2f) * 0.04f;
+				m->specular.z = std::pow(it.specular[2], 2.2f) * 0.04f;
+
+				m->emissive.x = it.emission[0];
+				m->emissive.y = it.emission[1];
+				m->emissive.z = it.emission[2];
+
+				m->ior = it.ior;
+				m->metalness = saturate(it.dissolve);
+				m->roughness = std::max(0.02f, saturate(it.shininess));
+
+				mats.push_back(m);
+			}
+
+			auto& scene = RenderScene::instance();
+			scene.beginUpdate();
+
+			// a Geometry carries a single material, so shapes with per-face materials are split
+			for (auto& shape : shapes)
+			{
+				auto& in = shape.mesh;
+
+				std::map<int, std::pair<std::shared_ptr<Mesh>, std::vector<std::int32_t>>> parts;
+
+				for (std::size_t face = 0; face < in.material_ids.size(); face++)
+				{
+					auto& part = parts[in.material_ids[face]];
+					if (!part.first)
+					{
+						part.first = std::make_shared<Mesh>();
+						part.second.resize(in.positions.size() / 3, -1);
+					}
+
+					auto& mesh = *part.first;
+					auto& remap = part.second;
+
+					for (std::size_t k = 0; k < 3; k++)
+					{
+						auto index = in.indices[face * 3 + k];
+						if (remap[index] < 0)
+						{
+							remap[index] = (std::int32_t)mesh.getNumVertices();
+
+							mesh.positions.insert(mesh.positions.end(), &in.positions[index * 3], &in.positions[index * 3] + 3);
+
+							if (!in.normals.empty())
+								mesh.normals.insert(mesh.normals.end(), &in.normals[index * 3], &in.normals[index * 3] + 3);
+							if (!in.texcoords.empty())
+								mesh.texcoords.insert(mesh.texcoords.end(), &in.texcoords[index * 2], &in.texcoords[index * 2] + 2);
+						}
+
+						mesh.indices.push_back(remap[index]);
+					}
+				}
+
+				for (auto& part : parts)
 				{
-					pipeline_->render(*camera, frame,
-						x, y,
-						std::min<std::uint32_t>(tileWidth_, width_ - x),
-						std::min<std::uint32_t>(tileHeight_, height_ - y));
+					auto& mesh = part.second.first;
+					OptimizeMesh(*mesh);
+					mesh->compress();
+
+					auto geometry = std::make_shared<Geometry>();
+					geometry->setMesh(mesh);
+					if (part.first >= 0)
+						geometry->setMaterial(mats[part.first]);
+					geometry->setActive(true);
+
+					geometries_.push_back(geometry);
 				}
+			}
+
+			scene.endUpdate();
+		}
+
+		PreviewRect
+		System::getTileRect(std::uint32_t tile) const noexcept
+		{
+			auto w = (width_ + tileWidth_ - 1) / tileWidth_;
+			auto x = tile % w * tileWidth_;
+			auto y = tile / w * tileHeight_;
+
+			return PreviewRect{ x, y, std::min<std::uint32_t>(tileWidth_, width_ - x), std::min<std::uint32_t>(tileHeight_, height_ - y) };
+		}
+
+		void
+		System::renderTileLocal(Pipeline& pipeline, const WorkItem& item) noexcept
+		{
+			auto rect = this->getTileRect(item.tile);
+
+			// every frame owns its own range of sample indices, so consecutive frames never repeat one
+			for (std::uint32_t i = 0; i < item.spp; i++)
+				pipeline.render(RenderScene::instance().getCameraList(), item.frame * item.spp + i, rect.x, rect.y, rect.w, rect.h);
+
+			this->markDirty(rect);
+			this->onTileComplete(item.completion, TileCompletion{ item.frame, item.tile });
+		}
+
+		std::future<std::uint32_t>
+		System::submit(const WorkItem& work) noexcept
+		{
+			auto& group = this->getTileGroup(work.tile);
 
-				return tile;
+			auto item = work;
+			item.completion = completions_->acquire();
+
+			std::packaged_task<std::uint32_t()> task([=, &group]()
+			{
+				this->renderTileLocal(*group.pipeline, item);
+				return item.tile;
 			});
 
 			auto f = task.get_future();
 
-			lock_.lock();
-			task_.push(std::move(task));
-			lock_.unlock();
+			pending_++;
+
+			this->pushTask(group, std::move(task));
 
 			return std::move(f);
 		}
 
+		std::future<std::uint32_t>
+		System::renderTile(std::uint32_t frame, std::uint32_t tile) noexcept
+		{
+			return this->submit(WorkItem{ frame, tile, 1, nullptr });
+		}
+
 		std::future<std::uint32_t>
 		System::renderFullscreen(std::uint32_t frame) noexcept
 		{
-			std::packaged_task<std::uint32_t()> task([=]()
+			auto& group = *groups_.front();
+			auto completion = completions_->acquire();
+
+			std::packaged_task<std::uint32_t()> task([=, &group]()
 			{
-				auto& cameras = RenderScene::instance().getCameraList();
-				for (auto& camera : cameras)
-				{
-					pipeline_->render(*camera, frame,
-						0, 0,
-						width_, height_
-					);
-				}
+				group.pipeline->render(RenderScene::instance().getCameraList(), frame,
+					0, 0,
+					width_, height_
+				);
+
+				this->markDirty(PreviewRect{ 0, 0, width_, height_ });
+				this->onTileComplete(completion, TileCompletion{ frame, 0 });
 
 				return 0;
 			});
 
 			auto f = task.get_future();
 
-			lock_.lock();
-			task_.push(std::move(task));
-			lock_.unlock();
+			pending_++;
+
+			this->pushTask(group, std::move(task));
 
 			return std::move(f);
 		}
@@ -141,39 +645,717 @@ namespace octoon
 			auto w = (width_ + tileWidth_ - 1) / tileWidth_;
 			auto h = (height_ + tileHeight_ - 1) / tileHeight_;
 
-			for (std::int32_t i = 0; i < w * h; i++)
-				queues_.push_back(this->renderTile(frame, i));
+			if (tiles_.size() != w * h || tilesX_ != w || tilesY_ != h)
+				this->buildTileOrder(w, h);
+
+			// a camera activated after setup still has an empty film, size it before any of its tiles is
+			// queued. resize() holds the film lock, tiles already in flight for it are dropped by the film
+			for (auto& camera : RenderScene::instance().getCameraList())
+			{
+				auto& film = camera->getFilm();
+				if (film && (film->getWidth() != width_ || film->getHeight() != height_))
+					film->resize(width_, height_);
+			}
+
+			frames_.emplace_back(frame, w * h);
+
+			if (listener_)
+			{
+				// render nodes and the local worker take the tiles from the shared queue
+				std::lock_guard<std::mutex> guard(itemsLock_);
+
+				for (auto tile : tiles_)
+					items_.push_back(WorkItem{ frame, tile, samplesPerTile_, completions_->acquire() });
+
+				pending_ += w * h;
+				itemsSignal_.notify_all();
+			}
+			else
+			{
+				for (auto tile : tiles_)
+					this->submit(WorkItem{ frame, tile, samplesPerTile_, nullptr });
+			}
+
+			frame_ = frame;
+		}
+
+		const std::uint32_t*
+		System::data() const noexcept
+		{
+			if (denoise_ && !preview_.empty())
+				return preview_.data();
+
+			return groups_.front()->pipeline->data();
+		}
+
+		void
+		System::setDenoise(bool enable) noexcept
+		{
+			denoise_ = enable;
+			preview_.clear();
 		}
 
 		bool
-		System::wait_one() noexcept
+		System::getDenoise() const noexcept
+		{
+			return denoise_;
+		}
+
+		void
+		System::setDenoiseInterval(std::uint32_t frames) noexcept
+		{
+			denoiseInterval_ = std::max(frames, 1u);
+		}
+
+		std::uint32_t
+		System::getDenoiseInterval() const noexcept
+		{
+			return denoiseInterval_;
+		}
+
+		Denoiser&
+		System::getDenoiser() noexcept
+		{
+			return denoiser_;
+		}
+
+		void
+		System::denoise() noexcept
 		{
-			if (!queues_.empty())
+			auto& cameras = RenderScene::instance().getCameraList();
+			if (cameras.empty() || !cameras.front()->getFilm())
+				return;
+
+			denoiser_.denoise(*cameras.front()->getFilm(), denoised_);
+
+			preview_.resize(denoised_.size());
+
+	#pragma omp parallel for
+			for (std::int32_t i = 0; i < (std::int32_t)denoised_.size(); ++i)
 			{
-				queues_.front().wait();
-				queues_.erase(queues_.begin());
+				auto& hdr = denoised_[i];
+
+				std::uint8_t r = tonemapping_->map(hdr.x) * 255;
+				std::uint8_t g = tonemapping_->map(hdr.y) * 255;
+				std::uint8_t b = tonemapping_->map(hdr.z) * 255;
+
+				preview_[i] = 0xFF << 24 | b << 16 | g << 8 | r;
 			}
 
-			return !queues_.empty();
+			denoiseFrames_ = 0;
+			this->markDirty(PreviewRect{ 0, 0, width_, height_ });
 		}
 
 		void
-		System::thread() noexcept
+		System::markDirty(const PreviewRect& rect) noexcept
 		{
-			pipeline_ = std::make_unique<MonteCarlo>(width_, height_);
+			std::lock_guard<std::mutex> guard(dirtyLock_);
+
+			// a tile can finish again before the viewer picked it up
+			auto it = std::find_if(dirty_.begin(), dirty_.end(), [&](const PreviewRect& r) { return r.x == rect.x && r.y == rect.y && r.w == rect.w && r.h == rect.h; });
+			if (it == dirty_.end())
+				dirty_.push_back(rect);
+		}
+
+		bool
+		System::resolvePreview(std::vector<PreviewRect>& rects, bool flush) noexcept
+		{
+			auto now = std::chrono::steady_clock::now();
+			if (!flush && now - previewTime_ < std::chrono::milliseconds(previewInterval_))
+				return false;
+
+			if (denoise_ && denoiseFrames_ >= denoiseInterval_)
+				this->denoise();
 
-			while (!isQuitRequest_)
 			{
-				if (!task_.empty())
-				{
-					lock_.lock();
-					auto task = std::move(task_.front());
-					task_.pop();
-					lock_.unlock();
+				std::lock_guard<std::mutex> guard(dirtyLock_);
+				if (dirty_.empty())
+					return false;
 
-					task();
-				}
+				rects.swap(dirty_);
+				dirty_.clear();
 			}
+
+			// once most of the image changed one upload is cheaper than many small ones
+			std::uint64_t area = 0;
+			for (auto& rect : rects)
+				area += rect.w * rect.h;
+
+			if (area * 2 >= (std::uint64_t)width_ * height_)
+				rects.assign(1, PreviewRect{ 0, 0, width_, height_ });
+
+			previewTime_ = now;
+			return true;
+		}
+
+		void
+		System::setPreviewInterval(std::uint32_t milliseconds) noexcept
+		{
+			previewInterval_ = milliseconds;
+		}
+
+		std::uint32_t
+		System::getPreviewInterval() const noexcept
+		{
+			return previewInterval_;
+		}
+
+		void
+		System::setCheckpoint(const std::string& path, std::uint32_t interval) noexcept
+		{
+			checkpointPath_ = path;
+			checkpointInterval_ = interval;
+		}
+
+		bool
+		System::saveCheckpoint(const std::string& path, std::uint32_t frame) noexcept
+		{
+			auto& cameras = RenderScene::instance().getCameraList();
+
+			// written aside and renamed, so a node killed while saving keeps the previous checkpoint
+			auto temp = path + ".tmp";
+
+			{
+				std::ofstream stream(temp, std::ios_base::out | std::ios_base::binary);
+				if (!stream)
+					return false;
+
+				std::uint32_t header[] = { kCheckpointMagic, kCheckpointVersion, frame, (std::uint32_t)cameras.size() };
+				stream.write((const char*)header, sizeof(header));
+
+				for (auto& camera : cameras)
+				{
+					if (!camera->getFilm() || !camera->getFilm()->save(stream))
+						return false;
+				}
+
+				if (!stream.flush())
+					return false;
+			}
+
+			if (!SyncFile(temp))
+				return false;
+
+			return RenameOver(temp, path);
+		}
+
+		std::uint32_t
+		System::loadCheckpoint(const std::string& path) noexcept
+		{
+			std::ifstream stream(path, std::ios_base::in | std::ios_base::binary);
+			if (!stream)
+				return 0;
+
+			auto& cameras = RenderScene::instance().getCameraList();
+
+			std::uint32_t header[4] = { 0 };
+			stream.read((char*)header, sizeof(header));
+
+			if (!stream || header[0] != kCheckpointMagic || header[1] != kCheckpointVersion || header[3] != cameras.size())
+				return 0;
+
+			for (auto& camera : cameras)
+			{
+				if (!camera->getFilm())
+					camera->setFilm(std::make_shared<Film>(width_, height_));
+
+				auto& film = camera->getFilm();
+				if (film->getWidth() != width_ || film->getHeight() != height_)
+					film->resize(width_, height_);
+
+				if (!film->load(stream))
+				{
+					for (auto& it : cameras)
+						it->getFilm()->clear();
+					return 0;
+				}
+			}
+
+			frame_ = header[2];
+			return frame_;
+		}
+
+		void
+		System::setFramesInFlight(std::uint32_t frames) noexcept
+		{
+			framesInFlight_ = std::max<std::uint32_t>(1, frames);
+		}
+
+		std::uint32_t
+		System::getFramesInFlight() const noexcept
+		{
+			return framesInFlight_;
+		}
+
+		void
+		System::onFrameComplete(std::uint32_t frame) noexcept
+		{
+			if (checkpointInterval_ > 0 && frame % checkpointInterval_ == 0)
+				this->saveCheckpoint(checkpointPath_, frame);
+
+			// filtered later by resolvePreview(), off the path that hands out the next frame
+			if (denoise_)
+				denoiseFrames_++;
+		}
+
+		void
+		System::onTileComplete(MPSCQueueNode<TileCompletion>* node, const TileCompletion& completion) noexcept
+		{
+			completions_->push(node, completion);
+
+			// the consumer checks the queue under the lock before it sleeps, so the wakeup can't get lost
+			{
+				std::lock_guard<std::mutex> guard(completionLock_);
+			}
+
+			completionSignal_.notify_one();
+		}
+
+		bool
+		System::isFrameBlocking() const noexcept
+		{
+			if (frames_.empty())
+				return false;
+
+			// a checkpoint must not contain tiles of the following frame, so nothing new is queued behind it
+			auto last = frames_.back().first;
+			if (checkpointInterval_ > 0 && last % checkpointInterval_ == 0)
+				return true;
+
+			return frames_.size() >= framesInFlight_;
+		}
+
+		void
+		System::retire(const TileCompletion& completion) noexcept
+		{
+			pending_--;
+
+			auto it = std::find_if(frames_.begin(), frames_.end(), [&](const std::pair<std::uint32_t, std::uint32_t>& frame) { return frame.first == completion.frame; });
+			if (it != frames_.end() && --it->second == 0)
+			{
+				frames_.erase(it);
+				this->onFrameComplete(completion.frame);
+			}
+		}
+
+		bool
+		System::poll_one(TileCompletion& completion) noexcept
+		{
+			if (!completions_->pop(completion))
+				return false;
+
+			this->retire(completion);
+			return true;
+		}
+
+		bool
+		System::wait_one(TileCompletion& completion) noexcept
+		{
+			if (pending_ > 0)
+			{
+				if (!completions_->pop(completion))
+				{
+					std::unique_lock<std::mutex> guard(completionLock_);
+					completionSignal_.wait(guard, [&]() { return completions_->pop(completion); });
+				}
+
+				this->retire(completion);
+			}
+
+			return this->isFrameBlocking();
+		}
+
+		bool
+		System::wait_one() noexcept
+		{
+			TileCompletion completion;
+			return this->wait_one(completion);
+		}
+
+		void
+		System::wait_all() noexcept
+		{
+			while (pending_ > 0)
+				this->wait_one();
+		}
+
+		void
+		System::thread(WorkerGroup& group, std::uint32_t index, bool firstTouch, std::promise<void>& ready) noexcept
+		{
+			if (threadPinning_)
+				PinThread(group.cpus);
+
+#ifdef _OPENMP
+			// the team of this thread is reused by every parallel loop of its pipeline
+			omp_set_num_threads((int)group.cpus.size());
+
+			if (threadPinning_)
+			{
+#pragma omp parallel
+				PinThread(group.cpus);
+			}
+#endif
+
+			// the workspace is allocated here, so it lives on the node of the group
+			group.pipeline = std::make_unique<MonteCarlo>(width_, height_, backend_);
+
+			if (firstTouch)
+			{
+				auto first = height_ * index / (std::uint32_t)groups_.size();
+				auto last = height_ * (index + 1) / (std::uint32_t)groups_.size();
+
+				for (auto& camera : RenderScene::instance().getCameraList())
+					camera->getFilm()->clear(RadeonRays::int2(0, first), RadeonRays::int2(width_, last - first));
+			}
+
+			ready.set_value();
+
+			auto hasTasks = [&]()
+			{
+				std::lock_guard<std::mutex> guard(group.lock);
+				return !group.tasks.empty();
+			};
+
+			while (!group.quit)
+			{
+				std::packaged_task<std::uint32_t()> task;
+				WorkItem item;
+				bool hasItem = false;
+
+				if (listening_)
+				{
+					// the shared items of the render nodes, submit() wakes this signal for own tasks too
+					std::unique_lock<std::mutex> guard(itemsLock_);
+					itemsSignal_.wait(guard, [&]() { return group.quit || !items_.empty() || hasTasks(); });
+
+					if (!this->popTask(group, task) && !items_.empty())
+					{
+						item = items_.front();
+						items_.pop_front();
+						hasItem = true;
+					}
+				}
+				else
+				{
+					std::unique_lock<std::mutex> guard(group.lock);
+					group.signal.wait(guard, [&]() { return group.quit || listening_ || !group.tasks.empty(); });
+
+					if (!group.tasks.empty())
+					{
+						task = std::move(group.tasks.front());
+						group.tasks.pop();
+					}
+				}
+
+				if (task.valid())
+					task();
+				else if (hasItem)
+					this->renderTileLocal(*group.pipeline, item);
+			}
+		}
+
+		bool
+		System::popTask(WorkerGroup& group, std::packaged_task<std::uint32_t()>& task) noexcept
+		{
+			std::lock_guard<std::mutex> guard(group.lock);
+			if (group.tasks.empty())
+				return false;
+
+			task = std::move(group.tasks.front());
+			group.tasks.pop();
+			return true;
+		}
+
+		void
+		System::pushTask(WorkerGroup& group, std::packaged_task<std::uint32_t()>&& task) noexcept
+		{
+			{
+				std::lock_guard<std::mutex> guard(group.lock);
+				group.tasks.push(std::move(task));
+				group.signal.notify_one();
+			}
+
+			// a group serving render nodes sleeps on the item signal instead
+			if (listening_)
+			{
+				std::lock_guard<std::mutex> guard(itemsLock_);
+				itemsSignal_.notify_all();
+			}
+		}
+
+		bool
+		System::popItem(WorkItem& item, bool wait) noexcept
+		{
+			std::unique_lock<std::mutex> guard(itemsLock_);
+
+			if (wait)
+				itemsSignal_.wait(guard, [this]() { return !items_.empty() || isQuitRequest_; });
+
+			if (items_.empty() || isQuitRequest_)
+				return false;
+
+			item = items_.front();
+			items_.pop_front();
+			return true;
+		}
+
+		void
+		System::requeueItem(const WorkItem& item) noexcept
+		{
+			std::lock_guard<std::mutex> guard(itemsLock_);
+			items_.push_front(item);
+			itemsSignal_.notify_one();
+		}
+
+		void
+		System::mergeTile(const WorkItem& item, std::vector<FilmTile>& tiles) noexcept
+		{
+			auto& cameras = RenderScene::instance().getCameraList();
+
+			for (std::size_t c = 0; c < cameras.size(); c++)
+			{
+				auto& film = cameras[c]->getFilm();
+				auto& tile = tiles[c];
+
+				film->accumulate(tile);
+
+				auto& size = tile.getSize();
+				auto radiance = tile.getRadiance();
+				auto sampleCount = tile.getSampleCount();
+				auto color = tile.getColor();
+
+				for (std::int32_t i = 0; i < size.x * size.y; ++i)
+				{
+					float scale = 1.0f / std::max<std::uint32_t>(1, sampleCount[i]);
+
+					std::uint8_t r = tonemapping_->map(radiance[i].x * scale) * 255;
+					std::uint8_t g = tonemapping_->map(radiance[i].y * scale) * 255;
+					std::uint8_t b = tonemapping_->map(radiance[i].z * scale) * 255;
+
+					color[i] = 0xFF << 24 | b << 16 | g << 8 | r;
+				}
+
+				film->resolve(tile);
+			}
+
+			this->markDirty(this->getTileRect(item.tile));
+			this->onTileComplete(item.completion, TileCompletion{ item.frame, item.tile });
+		}
+
+		void
+		System::setSamplesPerTile(std::uint32_t spp) noexcept
+		{
+			samplesPerTile_ = std::min(std::max<std::uint32_t>(1, spp), kClusterMaxSamplesPerTile);
+		}
+
+		std::uint32_t
+		System::getSamplesPerTile() const noexcept
+		{
+			return samplesPerTile_;
+		}
+
+		bool
+		System::listen(std::uint16_t port) noexcept
+		{
+			if (listener_)
+				return false;
+
+			auto listener = std::make_unique<Socket>();
+			if (!listener->listen(port))
+				return false;
+
+			listener_ = std::move(listener);
+			acceptThread_ = std::thread(std::bind(&System::accept, this));
+
+			// the groups move over to the shared item queue
+			listening_ = true;
+
+			for (auto& group : groups_)
+			{
+				std::lock_guard<std::mutex> guard(group->lock);
+				group->signal.notify_one();
+			}
+
+			return true;
+		}
+
+		std::uint32_t
+		System::getWorkerCount() const noexcept
+		{
+			return workerCount_;
+		}
+
+		void
+		System::setWorkerTimeout(std::uint32_t milliseconds) noexcept
+		{
+			workerTimeout_ = milliseconds;
+		}
+
+		std::uint32_t
+		System::getWorkerTimeout() const noexcept
+		{
+			return workerTimeout_;
+		}
+
+		void
+		System::accept() noexcept
+		{
+			while (!isQuitRequest_)
+			{
+				auto socket = std::make_shared<Socket>(listener_->accept());
+				if (!socket->valid())
+					break;
+
+				// a node that hangs or loses power fails the recv, serve() then requeues its item
+				socket->setTimeout(workerTimeout_);
+				socket->setKeepAlive(true);
+
+				std::lock_guard<std::mutex> guard(itemsLock_);
+				sockets_.push_back(socket);
+				connections_.push_back(std::thread(std::bind(&System::serve, this, socket)));
+			}
+		}
+
+		void
+		System::serve(std::shared_ptr<Socket> socket) noexcept
+		{
+			auto& cameras = RenderScene::instance().getCameraList();
+
+			std::uint32_t hello[] = { kClusterMagic, kClusterVersion, width_, height_, (std::uint32_t)tileWidth_, (std::uint32_t)tileHeight_, (std::uint32_t)cameras.size() };
+			std::uint32_t reply[2] = { 0 };
+
+			if (!socket->send(hello, sizeof(hello)) || !socket->recv(reply, sizeof(reply)) || reply[0] != kClusterMagic || !reply[1])
+				return;
+
+			workerCount_++;
+
+			std::vector<FilmTile> tiles(cameras.size());
+			std::string buffer;
+			WorkItem item;
+
+			while (this->popItem(item, true))
+			{
+				std::uint32_t request[] = { item.frame, item.tile, item.spp };
+				std::uint32_t header[3] = { 0 };
+
+				if (!socket->send(request, sizeof(request)) || !socket->recv(header, sizeof(header)) || header[0] != item.frame || header[1] != item.tile)
+				{
+					this->requeueItem(item);
+					break;
+				}
+
+				// the node is trusted with nothing, the reply must be exactly the tile of every camera
+				auto rect = this->getTileRect(item.tile);
+				auto size = RadeonRays::int2(rect.w, rect.h);
+
+				std::size_t expected = 0;
+				for (auto& camera : cameras)
+					expected += FilmTile::getStreamSize(size, camera->getFilm()->getAovMask());
+
+				if (header[2] != expected)
+				{
+					this->requeueItem(item);
+					break;
+				}
+
+				buffer.resize(header[2]);
+				if (!socket->recv(&buffer[0], buffer.size()))
+				{
+					this->requeueItem(item);
+					break;
+				}
+
+				std::istringstream stream(buffer);
+
+				bool valid = true;
+				for (auto& tile : tiles)
+				{
+					valid = tile.load(stream, (std::size_t)rect.w * rect.h);
+					valid = valid && tile.getOffset().x == rect.x && tile.getOffset().y == rect.y && tile.getSize().x == rect.w && tile.getSize().y == rect.h;
+					if (!valid)
+						break;
+				}
+
+				if (!valid)
+				{
+					this->requeueItem(item);
+					break;
+				}
+
+				this->mergeTile(item, tiles);
+			}
+
+			workerCount_--;
+		}
+
+		bool
+		System::work(const std::string& host, std::uint16_t port) noexcept
+		{
+			Socket socket;
+			if (!socket.connect(host, port))
+				return false;
+
+			// waiting for work is normal here, only a coordinator that vanished ends the connection
+			socket.setKeepAlive(true);
+
+			auto& cameras = RenderScene::instance().getCameraList();
+
+			std::uint32_t hello[7] = { 0 };
+			if (!socket.recv(hello, sizeof(hello)))
+				return false;
+
+			bool accepted =
+				hello[0] == kClusterMagic && hello[1] == kClusterVersion &&
+				hello[2] == width_ && hello[3] == height_ && hello[6] == cameras.size() &&
+				hello[4] > 0 && hello[4] <= kClusterMaxTileSize &&
+				hello[5] > 0 && hello[5] <= kClusterMaxTileSize;
+
+			std::uint32_t reply[] = { kClusterMagic, accepted ? 1u : 0u };
+			if (!socket.send(reply, sizeof(reply)) || !accepted)
+				return false;
+
+			this->setTileWidth(hello[4]);
+			this->setTileHeight(hello[5]);
+
+			// every reply carries only the samples of its item, so nothing may be left over
+			for (auto& camera : cameras)
+				camera->getFilm()->clear();
+
+			auto numTiles = ((width_ + hello[4] - 1) / hello[4]) * ((height_ + hello[5] - 1) / hello[5]);
+
+			FilmTile tile;
+			std::uint32_t request[3];
+
+			while (socket.recv(request, sizeof(request)))
+			{
+				// a corrupt request would index past the films, drop the connection instead
+				if (request[1] >= numTiles || request[2] == 0 || request[2] > kClusterMaxSamplesPerTile)
+					return false;
+
+				WorkItem item = { request[0], request[1], request[2], nullptr };
+
+				this->submit(item);
+
+				TileCompletion completion;
+				this->wait_one(completion);
+
+				auto rect = this->getTileRect(item.tile);
+
+				std::ostringstream stream;
+				for (auto& camera : cameras)
+				{
+					camera->getFilm()->take(RadeonRays::int2(rect.x, rect.y), RadeonRays::int2(rect.w, rect.h), tile);
+					tile.save(stream);
+				}
+
+				auto data = stream.str();
+				std::uint32_t header[] = { item.frame, item.tile, (std::uint32_t)data.size() };
+
+				if (!socket.send(header, sizeof(header)) || !socket.send(data.data(), data.size()))
+					break;
+			}
+
+			return true;
 		}
 	}
 }
\ No newline at end of file